@@ -0,0 +1,109 @@
+#include <stdio.h>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "assetloader.hpp"
+
+AssetLoader::AssetLoader(unsigned int threadCount)
+	: queue(threadCount, &AssetLoader::load), pendingCount(0)
+{
+}
+
+AssetLoader::~AssetLoader(){
+}
+
+size_t AssetLoader::requestMesh(const char * objPath){
+	MeshRecord * record = new MeshRecord();
+	record->path = objPath;
+	record->loaded = false;
+	record->next = NULL;
+	record->state = MESH_LOADING;
+	record->gpu.vertexbuffer = record->gpu.normalbuffer = 0;
+	record->gpu.vertexCount = 0;
+	record->uploadedBytes = 0;
+	records.push_back(std::unique_ptr<MeshRecord>(record));
+	++pendingCount;
+	queue.push(record);
+	return records.size() - 1;
+}
+
+void AssetLoader::load(MeshRecord & record){
+	record.loaded = record.cpu.load(record.path.c_str());
+}
+
+bool AssetLoader::uploadSome(MeshRecord & record, size_t & byteBudget){
+	const size_t streamBytes = record.cpu.vertexCount() * sizeof(glm::vec3);
+	if (record.state == MESH_LOADING){
+		// First call for this mesh : allocate both buffers, they are filled piecewise below
+		record.state = MESH_UPLOADING;
+		record.gpu.vertexCount = (GLsizei)record.cpu.vertexCount();
+		glGenBuffers(1, &record.gpu.vertexbuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, record.gpu.vertexbuffer);
+		glBufferData(GL_ARRAY_BUFFER, streamBytes, NULL, GL_STATIC_DRAW);
+		glGenBuffers(1, &record.gpu.normalbuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, record.gpu.normalbuffer);
+		glBufferData(GL_ARRAY_BUFFER, streamBytes, NULL, GL_STATIC_DRAW);
+	}
+	while (byteBudget > 0 && record.uploadedBytes < 2 * streamBytes){
+		const bool normals = record.uploadedBytes >= streamBytes;
+		const size_t offset = record.uploadedBytes - (normals ? streamBytes : 0);
+		size_t size = streamBytes - offset;
+		if (size > byteBudget) size = byteBudget;
+		const char * source = (const char *)(normals ? record.cpu.normals() : record.cpu.vertices());
+		glBindBuffer(GL_ARRAY_BUFFER, normals ? record.gpu.normalbuffer : record.gpu.vertexbuffer);
+		glBufferSubData(GL_ARRAY_BUFFER, offset, size, source + offset);
+		record.uploadedBytes += size;
+		byteBudget -= size;
+	}
+	return record.uploadedBytes == 2 * streamBytes;
+}
+
+size_t AssetLoader::uploadPending(size_t byteBudget){
+	queue.takeCompleted(uploads);
+
+	size_t residentCount = 0;
+	while (!uploads.empty()){
+		MeshRecord & record = *uploads.front();
+		if (!record.loaded){
+			printf("Could not load %s\n", record.path.c_str());
+			record.state = MESH_FAILED;
+		}else if (byteBudget == 0 || !uploadSome(record, byteBudget)){
+			break;
+		}else{
+			record.state = MESH_RESIDENT;
+			record.cpu.release();
+			++residentCount;
+		}
+		--pendingCount;
+		uploads.pop_front();
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return residentCount;
+}
+
+bool AssetLoader::isResident(size_t handle) const {
+	return records[handle]->state == MESH_RESIDENT;
+}
+
+bool AssetLoader::hasFailed(size_t handle) const {
+	return records[handle]->state == MESH_FAILED;
+}
+
+bool AssetLoader::isIdle() const {
+	return pendingCount == 0;
+}
+
+const GpuMesh & AssetLoader::mesh(size_t handle) const {
+	return records[handle]->gpu;
+}
+
+void AssetLoader::releaseBuffers(){
+	for (size_t i = 0; i < records.size(); ++i){
+		GpuMesh & gpu = records[i]->gpu;
+		if (gpu.vertexbuffer != 0) glDeleteBuffers(1, &gpu.vertexbuffer);
+		if (gpu.normalbuffer != 0) glDeleteBuffers(1, &gpu.normalbuffer);
+		gpu.vertexbuffer = gpu.normalbuffer = 0;
+	}
+}
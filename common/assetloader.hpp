@@ -0,0 +1,82 @@
+#ifndef ASSETLOADER_HPP
+#define ASSETLOADER_HPP
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "objloader.hpp"
+#include "workqueue.hpp"
+
+// GL buffers of a loaded mesh, de-indexed like loadOBJ's output
+struct GpuMesh {
+	GLuint vertexbuffer;
+	GLuint normalbuffer;
+	GLsizei vertexCount;
+};
+
+// Loads batches of OBJ meshes in the background and uploads them to GL from the render thread.
+// Parsing (or mapping the binary sidecar, see MeshCache) runs on a pool of worker threads ; the
+// finished CPU buffers come back through a WorkQueue and are uploaded by uploadPending(),
+// at most a given number of bytes per call. Meshes can be requested before the GL context exists,
+// so loading overlaps window creation, and drawing can start before every mesh is resident.
+// Except for the workers, everything happens on the thread that owns the loader.
+class AssetLoader {
+public:
+	// threadCount 0 : workerThreadCount()
+	explicit AssetLoader(unsigned int threadCount = 0);
+	// Drops the requests not started yet and waits for the workers. Does not touch GL : call
+	// releaseBuffers() while the context is still current.
+	~AssetLoader();
+
+	// Queues an OBJ file and returns its handle. Does not need a GL context.
+	size_t requestMesh(const char * objPath);
+
+	// Needs the GL context. Uploads loaded meshes in request completion order, stopping once
+	// byteBudget bytes were sent ; big meshes are uploaded across several calls.
+	// Returns the number of meshes that became resident.
+	size_t uploadPending(size_t byteBudget);
+
+	bool isResident(size_t handle) const;
+	// True once loading the mesh failed (missing file, parse error...)
+	bool hasFailed(size_t handle) const;
+	// True when every request is either resident or failed
+	bool isIdle() const;
+	// Valid once isResident(handle)
+	const GpuMesh & mesh(size_t handle) const;
+
+	// Deletes the GL buffers of every mesh ; they must not be drawn afterwards. Needs the GL context.
+	void releaseBuffers();
+
+private:
+	AssetLoader(const AssetLoader &);
+	AssetLoader & operator=(const AssetLoader &);
+
+	enum MeshState { MESH_LOADING, MESH_UPLOADING, MESH_RESIDENT, MESH_FAILED };
+
+	struct MeshRecord {
+		std::string path;
+		MeshCache cpu;          // Written by a worker, released once uploaded
+		bool loaded;            // Worker result, valid once the record is published
+		MeshRecord * next;      // Link in the completion list
+		// Render thread only
+		MeshState state;
+		GpuMesh gpu;
+		size_t uploadedBytes;   // Of both streams, vertices first
+	};
+
+	static void load(MeshRecord & record);
+	bool uploadSome(MeshRecord & record, size_t & byteBudget);
+
+	std::vector<std::unique_ptr<MeshRecord> > records;
+	// After records : its workers are joined before the records go away
+	WorkQueue<MeshRecord> queue;
+	// Loaded meshes waiting for upload, oldest first
+	std::deque<MeshRecord *> uploads;
+	size_t pendingCount;
+};
+
+#endif
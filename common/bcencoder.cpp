@@ -0,0 +1,453 @@
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BCENCODER_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "bcencoder.hpp"
+#include "mappedfile.hpp"
+#include "parallel.hpp"
+#include "texture.hpp"
+
+namespace {
+
+// Block rows per parallel block
+const size_t MIN_BLOCK_ROWS = 4;
+// Least squares refinements of BC_QUALITY_HIGH ; it stops earlier once the error stops decreasing
+const int HIGH_QUALITY_REFINEMENTS = 8;
+
+// The 16 texels of a block, one array per channel so 4 texels fit a SIMD register
+struct ColorBlock {
+	float r[16], g[16], b[16];
+	unsigned char alpha[16];
+	bool transparent[16];     // BC1 only : encoded as index 3 of a 3 colors block
+	bool anyTransparent;
+};
+
+struct Color {
+	float r, g, b;
+};
+
+void readBlock(const unsigned char * pixels, unsigned int width, unsigned int height,
+	unsigned int blockX, unsigned int blockY, bool bc1, ColorBlock & block){
+	block.anyTransparent = false;
+	for (unsigned int i = 0; i < 16; ++i){
+		unsigned int x = std::min(blockX * 4 + i % 4, width - 1);
+		unsigned int y = std::min(blockY * 4 + i / 4, height - 1);
+		const unsigned char * texel = pixels + ((size_t)y * width + x) * 4;
+		block.r[i] = texel[0];
+		block.g[i] = texel[1];
+		block.b[i] = texel[2];
+		block.alpha[i] = texel[3];
+		block.transparent[i] = bc1 && texel[3] < 128;
+		block.anyTransparent |= block.transparent[i];
+	}
+}
+
+unsigned short quantize565(const Color & c){
+	int r = (int)(std::min(std::max(c.r, 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+	int g = (int)(std::min(std::max(c.g, 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+	int b = (int)(std::min(std::max(c.b, 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+	return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+// What the decoder gets back : the high bits repeated in the low ones
+Color expand565(unsigned short c){
+	int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+	Color color = { (float)((r << 3) | (r >> 2)), (float)((g << 2) | (g >> 4)), (float)((b << 3) | (b >> 2)) };
+	return color;
+}
+
+// Weight of the first endpoint in each palette entry ; the 3 colors mode has no 4th color
+const float FOUR_COLOR_WEIGHTS[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+const float THREE_COLOR_WEIGHTS[3] = { 1.0f, 0.0f, 0.5f };
+
+// Closest palette entry of every texel ; returns the sum of the squared distances. The
+// transparent texels of a 3 colors block take index 3 and do not count.
+float findIndices(const ColorBlock & block, const Color * palette, int paletteSize, unsigned char * indices){
+	float distances[16];
+#ifdef BCENCODER_SSE2
+	for (int i = 0; i < 16; i += 4){
+		const __m128 r = _mm_loadu_ps(block.r + i), g = _mm_loadu_ps(block.g + i), b = _mm_loadu_ps(block.b + i);
+		__m128 best = _mm_set1_ps(1e30f);
+		__m128i bestIndex = _mm_setzero_si128();
+		for (int p = 0; p < paletteSize; ++p){
+			const __m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[p].r));
+			const __m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[p].g));
+			const __m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[p].b));
+			const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+			const __m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, best));
+			best = _mm_min_ps(d, best);
+			bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(p)), _mm_andnot_si128(closer, bestIndex));
+		}
+		int lanes[4];
+		_mm_storeu_ps(distances + i, best);
+		_mm_storeu_si128((__m128i *)lanes, bestIndex);
+		for (int k = 0; k < 4; ++k)
+			indices[i + k] = (unsigned char)lanes[k];
+	}
+#else
+	for (int i = 0; i < 16; ++i){
+		float best = 1e30f;
+		int bestIndex = 0;
+		for (int p = 0; p < paletteSize; ++p){
+			const float dr = block.r[i] - palette[p].r, dg = block.g[i] - palette[p].g, db = block.b[i] - palette[p].b;
+			const float d = (dr * dr + dg * dg) + db * db;
+			if (d < best){
+				best = d;
+				bestIndex = p;
+			}
+		}
+		distances[i] = best;
+		indices[i] = (unsigned char)bestIndex;
+	}
+#endif
+	float error = 0.0f;
+	for (int i = 0; i < 16; ++i){
+		if (block.transparent[i])
+			indices[i] = 3;
+		else
+			error += distances[i];
+	}
+	return error;
+}
+
+// Quantized endpoints of a block, their indices and error
+struct ColorFit {
+	unsigned short c0, c1;
+	unsigned char indices[16];
+	float error;
+};
+
+// Orders the quantized endpoints for the mode (c0 > c1 : 4 colors, c0 <= c1 : 3 colors and
+// transparent black) and finds the indices. Equal endpoints can only be a 3 colors block, which
+// is fine since all its colors are then the same.
+void evaluate(const ColorBlock & block, const Color & e0, const Color & e1, bool threeColors, ColorFit & fit){
+	unsigned short c0 = quantize565(e0), c1 = quantize565(e1);
+	if (threeColors ? c0 > c1 : c0 < c1)
+		std::swap(c0, c1);
+	fit.c0 = c0;
+	fit.c1 = c1;
+	const Color p0 = expand565(c0), p1 = expand565(c1);
+	const bool four = c0 > c1;
+	const float * weights = four ? FOUR_COLOR_WEIGHTS : THREE_COLOR_WEIGHTS;
+	Color palette[4];
+	for (int p = 0; p < (four ? 4 : 3); ++p){
+		const float w = weights[p];
+		palette[p].r = p0.r * w + p1.r * (1.0f - w);
+		palette[p].g = p0.g * w + p1.g * (1.0f - w);
+		palette[p].b = p0.b * w + p1.b * (1.0f - w);
+	}
+	fit.error = findIndices(block, palette, four ? 4 : 3, fit.indices);
+}
+
+// Endpoints minimizing the squared error for the current indices
+bool leastSquares(const ColorBlock & block, const ColorFit & fit, Color & e0, Color & e1){
+	const bool four = fit.c0 > fit.c1;
+	const float * weights = four ? FOUR_COLOR_WEIGHTS : THREE_COLOR_WEIGHTS;
+	float aa = 0, ab = 0, bb = 0;
+	Color ax = { 0, 0, 0 }, bx = { 0, 0, 0 };
+	for (int i = 0; i < 16; ++i){
+		if (block.transparent[i])
+			continue;
+		const float a = weights[fit.indices[i]], b = 1.0f - a;
+		aa += a * a; ab += a * b; bb += b * b;
+		ax.r += a * block.r[i]; ax.g += a * block.g[i]; ax.b += a * block.b[i];
+		bx.r += b * block.r[i]; bx.g += b * block.g[i]; bx.b += b * block.b[i];
+	}
+	const float det = aa * bb - ab * ab;
+	if (fabsf(det) < 1e-6f)
+		return false;   // Every texel on the same palette entry
+	const float inverse = 1.0f / det;
+	e0.r = (ax.r * bb - bx.r * ab) * inverse; e0.g = (ax.g * bb - bx.g * ab) * inverse; e0.b = (ax.b * bb - bx.b * ab) * inverse;
+	e1.r = (bx.r * aa - ax.r * ab) * inverse; e1.g = (bx.g * aa - ax.g * ab) * inverse; e1.b = (bx.b * aa - ax.b * ab) * inverse;
+	return true;
+}
+
+void boundingBoxEndpoints(const ColorBlock & block, Color & e0, Color & e1){
+	Color low = { 255, 255, 255 }, high = { 0, 0, 0 }, mean = { 0, 0, 0 };
+	int count = 0;
+	for (int i = 0; i < 16; ++i){
+		if (block.transparent[i])
+			continue;
+		low.r = std::min(low.r, block.r[i]); high.r = std::max(high.r, block.r[i]);
+		low.g = std::min(low.g, block.g[i]); high.g = std::max(high.g, block.g[i]);
+		low.b = std::min(low.b, block.b[i]); high.b = std::max(high.b, block.b[i]);
+		mean.r += block.r[i]; mean.g += block.g[i]; mean.b += block.b[i];
+		++count;
+	}
+	if (count == 0){
+		e0 = e1 = low;
+		return;
+	}
+	mean.r /= count; mean.g /= count; mean.b /= count;
+	// Which diagonal of the box : green and blue follow red, or go against it
+	float rg = 0, rb = 0;
+	for (int i = 0; i < 16; ++i){
+		if (block.transparent[i])
+			continue;
+		rg += (block.r[i] - mean.r) * (block.g[i] - mean.g);
+		rb += (block.r[i] - mean.r) * (block.b[i] - mean.b);
+	}
+	// Inset by 1/16 of the extent : the extremes are rarely worth a palette entry of their own
+	Color inset = { (high.r - low.r) / 16.0f, (high.g - low.g) / 16.0f, (high.b - low.b) / 16.0f };
+	e0.r = high.r - inset.r; e1.r = low.r + inset.r;
+	e0.g = high.g - inset.g; e1.g = low.g + inset.g;
+	e0.b = high.b - inset.b; e1.b = low.b + inset.b;
+	if (rg < 0) std::swap(e0.g, e1.g);
+	if (rb < 0) std::swap(e0.b, e1.b);
+}
+
+void principalAxisEndpoints(const ColorBlock & block, Color & e0, Color & e1){
+	Color mean = { 0, 0, 0 };
+	int count = 0;
+	for (int i = 0; i < 16; ++i){
+		if (block.transparent[i])
+			continue;
+		mean.r += block.r[i]; mean.g += block.g[i]; mean.b += block.b[i];
+		++count;
+	}
+	if (count == 0){
+		e0 = e1 = mean;
+		return;
+	}
+	mean.r /= count; mean.g /= count; mean.b /= count;
+	float cov[6] = { 0, 0, 0, 0, 0, 0 };   // rr rg rb gg gb bb
+	for (int i = 0; i < 16; ++i){
+		if (block.transparent[i])
+			continue;
+		const float r = block.r[i] - mean.r, g = block.g[i] - mean.g, b = block.b[i] - mean.b;
+		cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+		cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+	}
+	// Power iteration, from the axis of largest spread
+	Color axis = { 1.0f, 1.0f, 1.0f };
+	if (cov[0] >= cov[3] && cov[0] >= cov[5]) axis.r = 2.0f; else if (cov[3] >= cov[5]) axis.g = 2.0f; else axis.b = 2.0f;
+	for (int iteration = 0; iteration < 8; ++iteration){
+		Color next = {
+			cov[0] * axis.r + cov[1] * axis.g + cov[2] * axis.b,
+			cov[1] * axis.r + cov[3] * axis.g + cov[4] * axis.b,
+			cov[2] * axis.r + cov[4] * axis.g + cov[5] * axis.b
+		};
+		const float length = std::max(fabsf(next.r), std::max(fabsf(next.g), fabsf(next.b)));
+		if (length < 1e-6f){
+			e0 = e1 = mean;   // A single color
+			return;
+		}
+		axis.r = next.r / length; axis.g = next.g / length; axis.b = next.b / length;
+	}
+	float low = 1e30f, high = -1e30f;
+	for (int i = 0; i < 16; ++i){
+		if (block.transparent[i])
+			continue;
+		const float t = (block.r[i] - mean.r) * axis.r + (block.g[i] - mean.g) * axis.g + (block.b[i] - mean.b) * axis.b;
+		low = std::min(low, t);
+		high = std::max(high, t);
+	}
+	e0.r = mean.r + axis.r * high; e0.g = mean.g + axis.g * high; e0.b = mean.b + axis.b * high;
+	e1.r = mean.r + axis.r * low; e1.g = mean.g + axis.g * low; e1.b = mean.b + axis.b * low;
+}
+
+void refine(const ColorBlock & block, bool threeColors, int refinements, ColorFit & best){
+	for (int i = 0; i < refinements; ++i){
+		Color e0, e1;
+		if (!leastSquares(block, best, e0, e1))
+			return;
+		ColorFit fit;
+		evaluate(block, e0, e1, threeColors, fit);
+		if (fit.error >= best.error)
+			return;
+		best = fit;
+	}
+}
+
+void writeColorBlock(const ColorFit & fit, unsigned char * out){
+	out[0] = (unsigned char)(fit.c0 & 0xff); out[1] = (unsigned char)(fit.c0 >> 8);
+	out[2] = (unsigned char)(fit.c1 & 0xff); out[3] = (unsigned char)(fit.c1 >> 8);
+	unsigned int bits = 0;
+	for (int i = 0; i < 16; ++i)
+		bits |= (unsigned int)fit.indices[i] << (2 * i);
+	for (int k = 0; k < 4; ++k)
+		out[4 + k] = (unsigned char)(bits >> (8 * k));
+}
+
+void compressColor(const ColorBlock & block, BcQuality quality, unsigned char * out){
+	const bool threeColors = block.anyTransparent;
+	Color e0, e1;
+	ColorFit best;
+	if (quality == BC_QUALITY_FAST){
+		boundingBoxEndpoints(block, e0, e1);
+		evaluate(block, e0, e1, threeColors, best);
+	}else{
+		principalAxisEndpoints(block, e0, e1);
+		evaluate(block, e0, e1, threeColors, best);
+		if (quality == BC_QUALITY_HIGH){
+			ColorFit box;
+			boundingBoxEndpoints(block, e0, e1);
+			evaluate(block, e0, e1, threeColors, box);
+			refine(block, threeColors, HIGH_QUALITY_REFINEMENTS, box);
+			refine(block, threeColors, HIGH_QUALITY_REFINEMENTS, best);
+			if (box.error < best.error)
+				best = box;
+		}else{
+			refine(block, threeColors, 1, best);
+		}
+	}
+	writeColorBlock(best, out);
+}
+
+// One BC3 alpha block ; a0 > a1 selects 6 interpolated values, a0 <= a1 4 of them plus 0 and 255
+int fitAlpha(const unsigned char * alpha, int a0, int a1, unsigned char * indices){
+	int palette[8];
+	palette[0] = a0;
+	palette[1] = a1;
+	if (a0 > a1){
+		for (int k = 2; k < 8; ++k)
+			palette[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+	}else{
+		for (int k = 2; k < 6; ++k)
+			palette[k] = ((6 - k) * a0 + (k - 1) * a1) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+	int error = 0;
+	for (int i = 0; i < 16; ++i){
+		int best = 0x7fffffff;
+		for (int p = 0; p < 8; ++p){
+			const int d = (alpha[i] - palette[p]) * (alpha[i] - palette[p]);
+			if (d < best){
+				best = d;
+				indices[i] = (unsigned char)p;
+			}
+		}
+		error += best;
+	}
+	return error;
+}
+
+void compressAlpha(const ColorBlock & block, BcQuality quality, unsigned char * out){
+	int low = 255, high = 0, innerLow = 255, innerHigh = 0;
+	for (int i = 0; i < 16; ++i){
+		low = std::min(low, (int)block.alpha[i]);
+		high = std::max(high, (int)block.alpha[i]);
+		if (block.alpha[i] != 0 && block.alpha[i] != 255){
+			innerLow = std::min(innerLow, (int)block.alpha[i]);
+			innerHigh = std::max(innerHigh, (int)block.alpha[i]);
+		}
+	}
+	unsigned char indices[16], other[16];
+	int a0 = high, a1 = low;
+	int error = fitAlpha(block.alpha, a0, a1, indices);
+	// The other mode keeps 0 and 255 exact, which pays off for cut-out edges
+	if (quality != BC_QUALITY_FAST && error > 0){
+		if (innerLow > innerHigh) innerLow = innerHigh = low;
+		const int otherError = fitAlpha(block.alpha, innerLow, innerHigh, other);
+		if (otherError < error){
+			a0 = innerLow;
+			a1 = innerHigh;
+			memcpy(indices, other, sizeof(indices));
+		}
+	}
+	out[0] = (unsigned char)a0;
+	out[1] = (unsigned char)a1;
+	unsigned long long bits = 0;
+	for (int i = 0; i < 16; ++i)
+		bits |= (unsigned long long)indices[i] << (3 * i);
+	for (int k = 0; k < 6; ++k)
+		out[2 + k] = (unsigned char)(bits >> (8 * k));
+}
+
+// DDS header fields
+const unsigned int DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000;
+const unsigned int DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+const unsigned int DDPF_FOURCC = 0x4;
+const unsigned int DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+
+void writeLE32(unsigned char * p, unsigned int value){
+	p[0] = (unsigned char)value; p[1] = (unsigned char)(value >> 8);
+	p[2] = (unsigned char)(value >> 16); p[3] = (unsigned char)(value >> 24);
+}
+
+} // namespace
+
+void compressImage(const unsigned char * pixels, unsigned int width, unsigned int height,
+	BcFormat format, BcQuality quality, std::vector<unsigned char> & blocks){
+	const unsigned int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	const size_t blockBytes = format == BC_FORMAT_BC1 ? 8 : 16;
+	blocks.resize(blocksX * blocksY * blockBytes);
+	parallelForBlocks(blocksY, MIN_BLOCK_ROWS, [&](size_t begin, size_t end){
+		ColorBlock block;
+		for (size_t by = begin; by < end; ++by){
+			for (unsigned int bx = 0; bx < blocksX; ++bx){
+				unsigned char * out = &blocks[(by * blocksX + bx) * blockBytes];
+				readBlock(pixels, width, height, bx, (unsigned int)by, format == BC_FORMAT_BC1, block);
+				if (format == BC_FORMAT_BC3){
+					compressAlpha(block, quality, out);
+					out += 8;
+				}
+				compressColor(block, quality, out);
+			}
+		}
+	});
+}
+
+bool writeDDS(const char * path, const MipChain & chain, BcFormat format, BcQuality quality){
+	std::vector<std::vector<unsigned char> > levels(chain.levelCount());
+	for (size_t level = 0; level < chain.levelCount(); ++level)
+		compressImage(chain.level(level), chain.levelWidth(level), chain.levelHeight(level), format, quality, levels[level]);
+
+	// "DDS " and the header ; fields not set here stay 0
+	unsigned char header[128];
+	memset(header, 0, sizeof(header));
+	memcpy(header, "DDS ", 4);
+	unsigned char * h = header + 4;
+	writeLE32(&h[0], 124);
+	writeLE32(&h[4], DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE);
+	writeLE32(&h[8], chain.height);
+	writeLE32(&h[12], chain.width);
+	writeLE32(&h[16], (unsigned int)levels[0].size());
+	writeLE32(&h[24], (unsigned int)chain.levelCount());
+	writeLE32(&h[72], 32);   // Pixel format
+	writeLE32(&h[76], DDPF_FOURCC);
+	memcpy(&h[80], format == BC_FORMAT_BC1 ? "DXT1" : "DXT5", 4);
+	writeLE32(&h[104], DDSCAPS_TEXTURE | DDSCAPS_MIPMAP | DDSCAPS_COMPLEX);
+
+	std::vector<FileChunk> chunks;
+	FileChunk headerChunk = { header, sizeof(header) };
+	chunks.push_back(headerChunk);
+	for (size_t level = 0; level < levels.size(); ++level){
+		FileChunk levelChunk = { levels[level].data(), levels[level].size() };
+		chunks.push_back(levelChunk);
+	}
+	if (!writeFileReplacing(path, chunks)){
+		printf("Could not write %s\n", path);
+		return false;
+	}
+	return true;
+}
+
+bool convertBMPToDDS(const char * bmpPath, const char * ddsPath, BcFormat format, BcQuality quality, bool srgb){
+	MappedFile file;
+	if (!file.open(bmpPath)){
+		printf("%s could not be opened. Are you in the right directory ?\n", bmpPath);
+		return false;
+	}
+	BmpImage image;
+	if (!decodeBMP(bmpPath, (const unsigned char *)file.data(), file.size(), image))
+		return false;
+
+	// BGR to RGBA, in the row order of the file
+	std::vector<unsigned char> pixels((size_t)image.width * image.height * 4);
+	expandBMPPixels(image, true, &pixels[0]);
+	MipChain chain;
+	generateMipChain(&pixels[0], image.width, image.height, MIP_FILTER_KAISER, srgb, chain);
+	return writeDDS(ddsPath, chain, format, quality);
+}
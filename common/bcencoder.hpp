@@ -0,0 +1,38 @@
+#ifndef BCENCODER_HPP
+#define BCENCODER_HPP
+
+#include <vector>
+
+#include "mipmap.hpp"
+
+// Block compression to the formats loadDDS reads : BC1 (DXT1, 4 bits per texel, 1 bit alpha)
+// and BC3 (DXT5, 8 bits per texel, smooth alpha). Each 4x4 block gets two 5:6:5 colors and a
+// 2 bits index per texel into the 4 colors between them ; BC3 adds two alpha values and a
+// 3 bits index per texel.
+
+enum BcFormat {
+	BC_FORMAT_BC1,   // GL_COMPRESSED_RGBA_S3TC_DXT1_EXT ; texels with alpha < 128 become transparent black
+	BC_FORMAT_BC3    // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+};
+
+enum BcQuality {
+	BC_QUALITY_FAST,     // Endpoints from the bounding box of the block
+	BC_QUALITY_NORMAL,   // Endpoints along the principal axis of the colors, refined once
+	BC_QUALITY_HIGH      // Best of both, refined until the error stops decreasing
+};
+
+// Compresses an RGBA image (rows tightly packed, any size : edge blocks repeat the last row and
+// column). Block rows are spread over workerThreadCount() threads ; the closest palette entries
+// are searched 4 texels at a time with SSE2 when it is there. The blocks are stored row by row,
+// in the order of the image rows.
+void compressImage(const unsigned char * pixels, unsigned int width, unsigned int height,
+	BcFormat format, BcQuality quality, std::vector<unsigned char> & blocks);
+
+// Compresses every level of an RGBA chain into a DDS file loadDDS can read. Rows are kept in
+// the order of the chain, so a chain made from a BMP file samples like loadBMP_custom.
+bool writeDDS(const char * path, const MipChain & chain, BcFormat format, BcQuality quality);
+
+// BMP file -> mipmapped DDS file (Kaiser-filtered mipmaps, in linear space when srgb)
+bool convertBMPToDDS(const char * bmpPath, const char * ddsPath, BcFormat format, BcQuality quality, bool srgb = true);
+
+#endif
@@ -0,0 +1,272 @@
+#ifndef FASTPARSE_HPP
+#define FASTPARSE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FASTPARSE_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// Small, locale-free helpers to parse numbers straight out of a memory buffer
+// (typically a MappedFile). None of them needs a null-terminated string.
+
+inline bool isBlankChar(char c){
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline bool isSpaceChar(char c){
+	return isBlankChar(c) || c == '\n';
+}
+
+inline const char * skipBlankChars(const char * p, const char * end){
+	while (p != end && isBlankChar(*p)) ++p;
+	return p;
+}
+
+// Returns the first occurrence of c in [p, end), or end. Scans 16 bytes per step with SSE2.
+inline const char * findChar(const char * p, const char * end, char c){
+#ifdef FASTPARSE_SSE2
+	const __m128i needle = _mm_set1_epi8(c);
+	while (end - p >= 16){
+		__m128i block = _mm_loadu_si128((const __m128i *)p);
+		unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+		if (mask != 0){
+#ifdef _MSC_VER
+			unsigned long bit;
+			_BitScanForward(&bit, mask);
+			return p + bit;
+#else
+			return p + __builtin_ctz(mask);
+#endif
+		}
+		p += 16;
+	}
+#endif
+	while (p != end && *p != c) ++p;
+	return p;
+}
+
+inline const char * findNewline(const char * p, const char * end){
+	return findChar(p, end, '\n');
+}
+
+// Slow, careful path of parseDouble : any number of digits.
+// p points after the optional sign.
+inline const char * parseDoubleDigits(const char * p, const char * end, uint64_t & mantissa, int & exponent){
+	mantissa = 0;
+	exponent = 0;
+	int digits = 0;      // Significant digits stored in mantissa
+	bool anyDigit = false;
+
+	// Integer part
+	while (p != end && (unsigned)(*p - '0') < 10){
+		anyDigit = true;
+		if (digits < 19){
+			mantissa = mantissa * 10 + (unsigned)(*p - '0');
+			if (mantissa != 0) ++digits;
+		}else{
+			++exponent; // Too many digits : drop them, keep the magnitude
+		}
+		++p;
+	}
+	// Fractional part
+	if (p != end && *p == '.'){
+		++p;
+		while (p != end && (unsigned)(*p - '0') < 10){
+			anyDigit = true;
+			if (digits < 19){
+				mantissa = mantissa * 10 + (unsigned)(*p - '0');
+				if (mantissa != 0) ++digits;
+				--exponent;
+			}
+			++p;
+		}
+	}
+	return anyDigit ? p : NULL;
+}
+
+// Parses a decimal floating point number ("-1.5", "2e-3", ".5", "7.").
+// Returns the position after the number, or NULL if [p, end) does not start with a number.
+// Mantissas below 2^53 with |exponent| <= 22 (nearly every number found in asset files) are
+// correctly rounded ; anything else falls back to a pow() based evaluation. Converted to float,
+// results are within 1 ulp of strtof : rounding twice (to double, then float) can change the last bit.
+inline const char * parseDouble(const char * p, const char * end, double & out){
+	static const double powersOf10[] = {
+		1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	bool negative = false;
+	if (p != end && (*p == '-' || *p == '+')){
+		negative = (*p == '-');
+		++p;
+	}
+
+	// Fast path : accumulate every digit, which cannot overflow for up to 19 digits (the usual case)
+	const char * start = p;
+	uint64_t mantissa = 0;
+	while (p != end && (unsigned)(*p - '0') < 10){
+		mantissa = mantissa * 10 + (unsigned)(*p - '0');
+		++p;
+	}
+	size_t digitCount = (size_t)(p - start);
+	int exponent = 0;
+	if (p != end && *p == '.'){
+		const char * fraction = ++p;
+		while (p != end && (unsigned)(*p - '0') < 10){
+			mantissa = mantissa * 10 + (unsigned)(*p - '0');
+			++p;
+		}
+		exponent = -(int)(p - fraction);
+		digitCount += (size_t)(p - fraction);
+	}
+	if (digitCount == 0)
+		return NULL;
+	if (digitCount > 19)
+		p = parseDoubleDigits(start, end, mantissa, exponent);
+
+	// Exponent
+	if (p != end && (*p == 'e' || *p == 'E')){
+		const char * q = p + 1;
+		bool negativeExponent = false;
+		if (q != end && (*q == '-' || *q == '+')){
+			negativeExponent = (*q == '-');
+			++q;
+		}
+		if (q != end && (unsigned)(*q - '0') < 10){
+			int e = 0;
+			while (q != end && (unsigned)(*q - '0') < 10){
+				if (e < 100000) e = e * 10 + (*q - '0');
+				++q;
+			}
+			exponent += negativeExponent ? -e : e;
+			p = q;
+		}
+		// else : "1e" is read as "1" followed by garbage, which the caller will reject
+	}
+
+	double value;
+	if (mantissa == 0){
+		value = 0.0;
+	}else if (mantissa < ((uint64_t)1 << 53) && exponent >= -22 && exponent <= 22){
+		// Both operands are exact doubles : a single IEEE operation is correctly rounded
+		value = (double)mantissa;
+		value = (exponent < 0) ? value / powersOf10[-exponent] : value * powersOf10[exponent];
+	}else{
+		// Extended precision (where available) keeps long mantissas and large exponents close to exact
+		long double power = std::pow(10.0L, (long double)(exponent < 0 ? -exponent : exponent));
+		value = (double)(exponent < 0 ? (long double)mantissa / power : (long double)mantissa * power);
+	}
+	out = negative ? -value : value;
+	return p;
+}
+
+inline const char * parseFloat(const char * p, const char * end, float & out){
+	double value;
+	p = parseDouble(p, end, value);
+	if (p != NULL)
+		out = (float)value;
+	return p;
+}
+
+// Parses an optionally signed decimal integer. Returns NULL if there is no digit.
+inline const char * parseInt(const char * p, const char * end, long long & out){
+	bool negative = false;
+	if (p != end && (*p == '-' || *p == '+')){
+		negative = (*p == '-');
+		++p;
+	}
+	if (p == end || (unsigned)(*p - '0') >= 10)
+		return NULL;
+	unsigned long long value = 0;
+	while (p != end && (unsigned)(*p - '0') < 10){
+		value = value * 10 + (unsigned)(*p - '0');
+		++p;
+	}
+	out = negative ? -(long long)value : (long long)value;
+	return p;
+}
+
+// Whitespace separated token reader over [begin, end) that keeps track of
+// the line / column of the current position for error messages.
+// '#' starts a comment that runs to the end of the line.
+class TextScanner {
+public:
+	TextScanner(const char * begin, const char * end)
+		: cur(begin), last(end), lineStart(begin), lineNumber(1) { }
+
+	// Skips whitespace and comments. Returns false once the input is exhausted.
+	bool skipBlank(){
+		while (cur != last){
+			char c = *cur;
+			if (c == '\n'){
+				++cur;
+				++lineNumber;
+				lineStart = cur;
+			}else if (isBlankChar(c)){
+				++cur;
+			}else if (c == '#'){
+				while (cur != last && *cur != '\n') ++cur;
+			}else{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Reads the next whitespace separated word. word is NOT null-terminated.
+	bool readWord(const char * & word, size_t & length){
+		if (!skipBlank())
+			return false;
+		word = cur;
+		while (cur != last && !isSpaceChar(*cur) && *cur != '#') ++cur;
+		length = (size_t)(cur - word);
+		return true;
+	}
+
+	bool readDouble(double & value){
+		if (!skipBlank())
+			return false;
+		return finishToken(parseDouble(cur, last, value));
+	}
+
+	bool readFloat(float & value){
+		if (!skipBlank())
+			return false;
+		return finishToken(parseFloat(cur, last, value));
+	}
+
+	bool readInt(long long & value){
+		if (!skipBlank())
+			return false;
+		return finishToken(parseInt(cur, last, value));
+	}
+
+	const char * position() const { return cur; }
+	size_t line() const { return lineNumber; }
+	size_t column() const { return (size_t)(cur - lineStart) + 1; }
+
+private:
+	// A number must be followed by whitespace, a comment or the end of input
+	bool finishToken(const char * next){
+		if (next == NULL)
+			return false;
+		if (next != last && !isSpaceChar(*next) && *next != '#')
+			return false;
+		cur = next;
+		return true;
+	}
+
+	const char * cur;
+	const char * last;
+	const char * lineStart;
+	size_t lineNumber;
+};
+
+#endif
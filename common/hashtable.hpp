@@ -0,0 +1,107 @@
+#ifndef HASHTABLE_HPP
+#define HASHTABLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Open-addressing (linear probing) hash table of dense uint32 ids, used for vertex deduplication.
+// The table stores only ids and 32 bits of their hash ; the keys themselves stay in the caller's
+// arrays and are compared through a callback. Capacity is reserved up front from the expected
+// number of ids, so filling it never rehashes unless more ids than expected arrive.
+class IdHashTable {
+public:
+	IdHashTable() : mask(0), count(0) { }
+	explicit IdHashTable(size_t expectedIds) : mask(0), count(0) { reserve(expectedIds); }
+
+	void reserve(size_t expectedIds){
+		// Keep the load factor under 1/2
+		size_t capacity = 16;
+		while (capacity < expectedIds * 2) capacity *= 2;
+		if (capacity > slots.size())
+			rehash(capacity);
+	}
+
+	// Returns the id stored for a key equal to the searched one (isMatch(id) must tell),
+	// or stores newId for it and returns newId.
+	template <typename Match>
+	uint32_t findOrInsert(uint64_t hash, uint32_t newId, Match isMatch){
+		if ((count + 1) * 2 > slots.size())
+			rehash(slots.empty() ? 16 : slots.size() * 2);
+		const uint32_t bits = (uint32_t)(hash ^ (hash >> 32));
+		for (size_t i = bits & mask; ; i = (i + 1) & mask){
+			Slot & slot = slots[i];
+			if (slot.id == EMPTY){
+				slot.id = newId;
+				slot.hash = bits;
+				++count;
+				return newId;
+			}
+			if (slot.hash == bits && isMatch(slot.id))
+				return slot.id;
+		}
+	}
+
+	// Returns the id stored for a key equal to the searched one, or NOT_FOUND
+	template <typename Match>
+	uint32_t find(uint64_t hash, Match isMatch) const {
+		if (slots.empty())
+			return NOT_FOUND;
+		const uint32_t bits = (uint32_t)(hash ^ (hash >> 32));
+		for (size_t i = bits & mask; ; i = (i + 1) & mask){
+			const Slot & slot = slots[i];
+			if (slot.id == EMPTY)
+				return NOT_FOUND;
+			if (slot.hash == bits && isMatch(slot.id))
+				return slot.id;
+		}
+	}
+
+	size_t size() const { return count; }
+
+	// An enum rather than a static member, so it can be passed by reference without a definition
+	enum : uint32_t { NOT_FOUND = 0xFFFFFFFFu };
+
+	// 64-bit mix of a block of 32-bit words (e.g. the bit patterns of a vertex)
+	static uint64_t hashWords(const uint32_t * words, size_t n){
+		uint64_t hash = 0x9E3779B97F4A7C15ULL;
+		for (size_t i = 0; i < n; ++i){
+			hash ^= words[i];
+			hash *= 0xff51afd7ed558ccdULL;
+			hash ^= hash >> 32;
+		}
+		hash ^= hash >> 29;
+		hash *= 0xc4ceb9fe1a85ec53ULL;
+		hash ^= hash >> 32;
+		return hash;
+	}
+
+private:
+	static const uint32_t EMPTY = 0xFFFFFFFFu;
+
+	struct Slot {
+		uint32_t id;
+		uint32_t hash;
+	};
+
+	void rehash(size_t capacity){
+		std::vector<Slot> old;
+		old.swap(slots);
+		Slot empty = { EMPTY, 0 };
+		slots.assign(capacity, empty);
+		mask = capacity - 1;
+		for (size_t s = 0; s < old.size(); ++s){
+			if (old[s].id == EMPTY)
+				continue;
+			size_t i = old[s].hash & mask;
+			while (slots[i].id != EMPTY) i = (i + 1) & mask;
+			slots[i] = old[s];
+		}
+	}
+
+	std::vector<Slot> slots;
+	size_t mask;
+	size_t count;
+};
+
+#endif
@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <functional>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mappedfile.hpp"
+
+// Empty files cannot be mapped ; they are exposed as a valid zero-length range instead.
+static const char emptyFile[1] = { 0 };
+
+MappedFile::MappedFile()
+	: mappedData(emptyFile), mappedSize(0), opened(false)
+#ifdef _WIN32
+	, fileHandle(INVALID_HANDLE_VALUE), mappingHandle(NULL)
+#endif
+{
+}
+
+MappedFile::~MappedFile(){
+	close();
+}
+
+#ifdef _WIN32
+
+bool getFileInfo(const char * path, FileInfo & info){
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA(path, GetFileExInfoStandard, &attributes))
+		return false;
+	info.size = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+	// FILETIME counts 100ns intervals
+	info.modificationTime = (int64_t)((((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime) * 100);
+	return true;
+}
+
+bool MappedFile::open(const char * path){
+	close();
+
+	fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize)){
+		close();
+		return false;
+	}
+	opened = true;
+	if (fileSize.QuadPart == 0)
+		return true;
+
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mappingHandle == NULL){
+		close();
+		return false;
+	}
+	const void * view = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (view == NULL){
+		close();
+		return false;
+	}
+	mappedData = (const char *)view;
+	mappedSize = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+void MappedFile::close(){
+	if (mappedSize > 0)
+		UnmapViewOfFile(mappedData);
+	if (mappingHandle != NULL)
+		CloseHandle(mappingHandle);
+	if (fileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(fileHandle);
+	mappingHandle = NULL;
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappedData = emptyFile;
+	mappedSize = 0;
+	opened = false;
+}
+
+#else
+
+bool getFileInfo(const char * path, FileInfo & info){
+	struct stat st;
+	if (stat(path, &st) != 0)
+		return false;
+	info.size = (uint64_t)st.st_size;
+#if defined(__APPLE__)
+	info.modificationTime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+	info.modificationTime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+	return true;
+}
+
+bool MappedFile::open(const char * path){
+	close();
+
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0){
+		::close(fd);
+		return false;
+	}
+	opened = true;
+	if (info.st_size == 0){
+		::close(fd);
+		return true;
+	}
+
+	void * view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping keeps its own reference to the file
+	::close(fd);
+	if (view == MAP_FAILED){
+		opened = false;
+		return false;
+	}
+	// We read front to back, let the kernel read ahead aggressively
+	madvise(view, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+	mappedData = (const char *)view;
+	mappedSize = (size_t)info.st_size;
+	return true;
+}
+
+void MappedFile::close(){
+	if (mappedSize > 0)
+		munmap((void *)mappedData, mappedSize);
+	mappedData = emptyFile;
+	mappedSize = 0;
+	opened = false;
+}
+
+#endif
+
+uint64_t hashBytes(const void * data, size_t size, uint64_t seed){
+	// FNV-1a style mixing over 64-bit words, with a final avalanche
+	const uint64_t prime = 0x100000001b3ULL;
+	uint64_t hash = 0xcbf29ce484222325ULL ^ seed;
+	const unsigned char * p = (const unsigned char *)data;
+	size_t words = size / 8;
+	for (size_t i = 0; i < words; ++i){
+		uint64_t word;
+		memcpy(&word, p + i * 8, 8);
+		hash = (hash ^ word) * prime;
+		hash ^= hash >> 29;
+	}
+	for (size_t i = words * 8; i < size; ++i)
+		hash = (hash ^ p[i]) * prime;
+	hash ^= (uint64_t)size;
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+bool writeFileReplacing(const char * path, const std::vector<FileChunk> & chunks){
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%016llx.tmp", (unsigned long long)std::hash<std::thread::id>()(std::this_thread::get_id()));
+	std::string temporaryPath = std::string(path) + suffix;
+	FILE * file = fopen(temporaryPath.c_str(), "wb");
+	if (file == NULL)
+		return false;
+	bool ok = true;
+	for (size_t c = 0; ok && c < chunks.size(); ++c)
+		ok = chunks[c].size == 0 || fwrite(chunks[c].data, 1, chunks[c].size, file) == chunks[c].size;
+	if (fclose(file) != 0) ok = false;
+	if (ok){
+		remove(path); // rename() does not replace existing files on Windows
+		ok = rename(temporaryPath.c_str(), path) == 0;
+	}
+	if (!ok)
+		remove(temporaryPath.c_str());
+	return ok;
+}
@@ -0,0 +1,59 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Read-only memory mapping of a whole file.
+// The contents stay valid until close() or destruction ; the mapping is not null-terminated.
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const char * path);
+	void close();
+
+	bool isOpen() const { return opened; }
+	const char * data() const { return mappedData; }
+	size_t size() const { return mappedSize; }
+	const char * begin() const { return mappedData; }
+	const char * end() const { return mappedData + mappedSize; }
+
+private:
+	MappedFile(const MappedFile &);
+	MappedFile & operator=(const MappedFile &);
+
+	const char * mappedData;
+	size_t mappedSize;
+	bool opened;
+#ifdef _WIN32
+	void * fileHandle;
+	void * mappingHandle;
+#endif
+};
+
+// Size and last modification time of a file, used to validate derived cache files
+struct FileInfo {
+	uint64_t size;
+	int64_t modificationTime;  // Nanoseconds, platform epoch
+};
+
+bool getFileInfo(const char * path, FileInfo & info);
+
+// 64-bit hash of a byte range (8 bytes per step, not cryptographic)
+uint64_t hashBytes(const void * data, size_t size, uint64_t seed = 0);
+
+// A byte range written by writeFileReplacing
+struct FileChunk {
+	const void * data;
+	size_t size;
+};
+
+// Writes the chunks one after the other to a temporary file next to path and renames it to path,
+// so a crash never leaves a truncated file behind. The temporary name is per thread : two threads
+// writing the same path do not share it. Prints nothing ; on failure path may be missing.
+bool writeFileReplacing(const char * path, const std::vector<FileChunk> & chunks);
+
+#endif
@@ -0,0 +1,225 @@
+#include <vector>
+#include <math.h>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "meshoptimizer.hpp"
+#include "meshlet.hpp"
+
+namespace {
+
+void computeMeshletBounds(Meshlet & meshlet, const std::vector<unsigned int> & indices,
+                          const std::vector<glm::vec3> & positions, const std::vector<glm::vec3> & triangleNormals){
+	const unsigned int * first = &indices[meshlet.indexOffset];
+
+	// Sphere around the center of the bounding box
+	glm::vec3 boxMin = positions[first[0]], boxMax = boxMin;
+	for (unsigned int i = 1; i < meshlet.indexCount; ++i){
+		boxMin = glm::min(boxMin, positions[first[i]]);
+		boxMax = glm::max(boxMax, positions[first[i]]);
+	}
+	meshlet.center = (boxMin + boxMax) * 0.5f;
+	float radius2 = 0.0f;
+	for (unsigned int i = 0; i < meshlet.indexCount; ++i){
+		glm::vec3 d = positions[first[i]] - meshlet.center;
+		radius2 = glm::max(radius2, glm::dot(d, d));
+	}
+	meshlet.radius = sqrtf(radius2);
+
+	// Cone around the average normal ; degenerate triangles have a zero normal and are ignored
+	glm::vec3 axis(0.0f);
+	unsigned int firstTriangle = meshlet.indexOffset / 3;
+	for (unsigned int t = 0; t < meshlet.indexCount / 3; ++t)
+		axis += triangleNormals[firstTriangle + t];
+	float length = glm::length(axis);
+	meshlet.coneAxis = length > 0.0f ? axis / length : glm::vec3(0.0f, 0.0f, 1.0f);
+	meshlet.coneCutoff = 1.0f;
+	if (length == 0.0f)
+		return;
+	float minDot = 1.0f;
+	for (unsigned int t = 0; t < meshlet.indexCount / 3; ++t){
+		const glm::vec3 & n = triangleNormals[firstTriangle + t];
+		if (n != glm::vec3(0.0f))
+			minDot = glm::min(minDot, glm::dot(n, meshlet.coneAxis));
+	}
+	if (minDot > 0.0f)
+		meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+}
+
+} // namespace
+
+void buildMeshlets(
+	std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & positions,
+	std::vector<Meshlet> & meshlets,
+	unsigned int maxVertices,
+	unsigned int maxTriangles
+){
+	meshlets.clear();
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+	// Below this a meshlet could never hold a single triangle, and the loop below would not end
+	if (maxVertices < 3) maxVertices = 3;
+	if (maxTriangles < 1) maxTriangles = 1;
+	const size_t vertexCount = positions.size();
+
+	std::vector<glm::vec3> triangleNormals(triangleCount);
+	for (size_t t = 0; t < triangleCount; ++t){
+		const glm::vec3 & p0 = positions[indices[3 * t]];
+		const glm::vec3 & p1 = positions[indices[3 * t + 1]];
+		const glm::vec3 & p2 = positions[indices[3 * t + 2]];
+		glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(n);
+		triangleNormals[t] = length > 0.0f ? n / length : glm::vec3(0.0f);
+	}
+
+	// counts[v] is the number of triangles of v not emitted yet ; they are kept at the front of its list
+	TriangleAdjacency adjacency;
+	buildTriangleAdjacency(adjacency, indices, vertexCount);
+
+	std::vector<char> emitted(triangleCount, 0);
+	std::vector<unsigned int> inMeshlet(vertexCount, 0);   // Meshlet number + 1 of the last meshlet using the vertex
+	std::vector<unsigned int> meshletVertices;
+	std::vector<unsigned int> result;
+	std::vector<glm::vec3> resultNormals;   // Triangle normals in the new order, for the cones
+	result.reserve(indices.size());
+	resultNormals.reserve(triangleCount);
+	size_t deadEndCursor = 0;
+	size_t emittedCount = 0;
+
+	while (emittedCount < triangleCount){
+		Meshlet meshlet;
+		meshlet.indexOffset = (unsigned int)result.size();
+		meshlet.indexCount = 0;
+		const unsigned int stamp = (unsigned int)meshlets.size() + 1;
+		meshletVertices.clear();
+		glm::vec3 normalSum(0.0f);
+
+		while (emittedCount < triangleCount && meshlet.indexCount / 3 < maxTriangles){
+			// Best unemitted triangle around the meshlet's vertices
+			long long best = -1;
+			unsigned int bestNewVertices = 4;
+			float bestDot = -2.0f;
+			for (size_t i = 0; i < meshletVertices.size() && bestNewVertices > 0; ++i){
+				unsigned int v = meshletVertices[i];
+				const unsigned int * list = &adjacency.triangles[adjacency.offsets[v]];
+				for (unsigned int j = 0; j < adjacency.counts[v]; ++j){
+					unsigned int t = list[j];
+					unsigned int newVertices = (inMeshlet[indices[3 * t]] != stamp)
+					                         + (inMeshlet[indices[3 * t + 1]] != stamp)
+					                         + (inMeshlet[indices[3 * t + 2]] != stamp);
+					if (meshletVertices.size() + newVertices > maxVertices)
+						continue;
+					float d = glm::dot(triangleNormals[t], normalSum);
+					if (newVertices < bestNewVertices || (newVertices == bestNewVertices && d > bestDot)){
+						best = t;
+						bestNewVertices = newVertices;
+						bestDot = d;
+					}
+				}
+			}
+			if (best < 0){
+				// No neighbour fits : continue with the next triangle in index order, if it fits
+				while (emitted[deadEndCursor]) ++deadEndCursor;
+				unsigned int newVertices = 0;
+				for (int k = 0; k < 3; ++k)
+					newVertices += inMeshlet[indices[3 * deadEndCursor + k]] != stamp;
+				if (meshletVertices.size() + newVertices > maxVertices)
+					break;
+				best = (long long)deadEndCursor;
+			}
+
+			const unsigned int * triangle = &indices[3 * (size_t)best];
+			emitted[(size_t)best] = 1;
+			++emittedCount;
+			result.insert(result.end(), triangle, triangle + 3);
+			meshlet.indexCount += 3;
+			normalSum += triangleNormals[(size_t)best];
+			resultNormals.push_back(triangleNormals[(size_t)best]);
+			for (int k = 0; k < 3; ++k){
+				unsigned int v = triangle[k];
+				if (inMeshlet[v] != stamp){
+					inMeshlet[v] = stamp;
+					meshletVertices.push_back(v);
+				}
+				// Remove the triangle from the list of v
+				unsigned int * list = &adjacency.triangles[adjacency.offsets[v]];
+				unsigned int & count = adjacency.counts[v];
+				for (unsigned int j = 0; j < count; ++j){
+					if (list[j] == (unsigned int)best){
+						list[j] = list[count - 1];
+						--count;
+						break;
+					}
+				}
+			}
+		}
+
+		meshlet.vertexCount = (unsigned int)meshletVertices.size();
+		meshlets.push_back(meshlet);
+	}
+	indices.swap(result);
+
+	triangleNormals.swap(resultNormals);
+	for (size_t m = 0; m < meshlets.size(); ++m)
+		computeMeshletBounds(meshlets[m], indices, positions, triangleNormals);
+}
+
+void cullMeshlets(
+	const std::vector<Meshlet> & meshlets,
+	const glm::mat4 & MVP,
+	const glm::vec3 & cameraPosition,
+	size_t indexElementSize,
+	MeshletDrawList & drawList
+){
+	drawList.counts.clear();
+	drawList.offsets.clear();
+	drawList.visibleMeshlets = 0;
+
+	// Frustum planes (Gribb & Hartmann), in model space since MVP starts there
+	glm::vec4 planes[6];
+	for (int i = 0; i < 3; ++i){
+		glm::vec4 row(MVP[0][i], MVP[1][i], MVP[2][i], MVP[3][i]);
+		glm::vec4 w(MVP[0][3], MVP[1][3], MVP[2][3], MVP[3][3]);
+		planes[2 * i] = w + row;
+		planes[2 * i + 1] = w - row;
+	}
+	for (int i = 0; i < 6; ++i)
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+
+	size_t lastEnd = ~(size_t)0;
+	for (size_t m = 0; m < meshlets.size(); ++m){
+		const Meshlet & meshlet = meshlets[m];
+
+		bool outside = false;
+		for (int i = 0; i < 6 && !outside; ++i)
+			outside = glm::dot(glm::vec3(planes[i]), meshlet.center) + planes[i].w < -meshlet.radius;
+		if (outside)
+			continue;
+
+		// Every triangle faces away if every view direction from the camera to the sphere is within
+		// 90 degrees minus the cone angle of the axis ; conservative over the whole sphere
+		glm::vec3 toCenter = meshlet.center - cameraPosition;
+		if (glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius * (1.0f + meshlet.coneCutoff))
+			continue;
+
+		++drawList.visibleMeshlets;
+		size_t offset = meshlet.indexOffset * indexElementSize;
+		if (offset == lastEnd){
+			drawList.counts.back() += meshlet.indexCount;
+		}else{
+			drawList.counts.push_back(meshlet.indexCount);
+			drawList.offsets.push_back((const GLvoid*)offset);
+		}
+		lastEnd = offset + meshlet.indexCount * indexElementSize;
+	}
+}
+
+void drawMeshlets(const MeshletDrawList & drawList, GLenum indexType){
+	if (drawList.counts.empty())
+		return;
+	glMultiDrawElements(GL_TRIANGLES, &drawList.counts[0], indexType, &drawList.offsets[0], (GLsizei)drawList.counts.size());
+}
@@ -0,0 +1,63 @@
+#ifndef MESHLET_HPP
+#define MESHLET_HPP
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+// Splits an indexed triangle list into small clusters ("meshlets") that can be culled one by one.
+// The index buffer is reordered so every meshlet is a contiguous range of it ; culling then only
+// has to collect the visible ranges and draw them with one glMultiDrawElements call.
+struct Meshlet {
+	unsigned int indexOffset;   // First index of the meshlet in the reordered index buffer
+	unsigned int indexCount;    // 3 per triangle
+	unsigned int vertexCount;   // Distinct vertices used
+
+	glm::vec3 center;           // Bounding sphere
+	float radius;
+
+	// Normal cone : every triangle normal is within asin(coneCutoff) of coneAxis.
+	// coneCutoff is 1 when the normals are too spread for the cone to ever cull the meshlet.
+	glm::vec3 coneAxis;
+	float coneCutoff;
+};
+
+// Reorders indices meshlet by meshlet and fills meshlets. Triangles are grown greedily from a seed,
+// preferring neighbours that add the fewest new vertices, then the ones closest to the meshlet's
+// average normal (for tight cones). Run it after optimizeVertexCache : the seeds follow the
+// index order, and so does the order inside each meshlet. maxVertices is at least 3 and
+// maxTriangles at least 1 : smaller values are raised to these.
+void buildMeshlets(
+	std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & positions,
+	std::vector<Meshlet> & meshlets,
+	unsigned int maxVertices = 64,
+	unsigned int maxTriangles = 124
+);
+
+// Index ranges to draw this frame, in the form glMultiDrawElements wants
+struct MeshletDrawList {
+	std::vector<GLsizei> counts;
+	std::vector<const GLvoid*> offsets;   // Byte offsets into the bound GL_ELEMENT_ARRAY_BUFFER
+	size_t visibleMeshlets;
+};
+
+// Keeps the meshlets whose sphere intersects the view frustum and whose triangles are not all
+// back-facing. MVP and cameraPosition are in the mesh's model space (cameraPosition is
+// inverse(M) times the world space camera position). Adjacent visible meshlets are merged into
+// one range. indexElementSize is 2 or 4 (see IndexBuffer::elementSize).
+void cullMeshlets(
+	const std::vector<Meshlet> & meshlets,
+	const glm::mat4 & MVP,
+	const glm::vec3 & cameraPosition,
+	size_t indexElementSize,
+	MeshletDrawList & drawList
+);
+
+// Draws the ranges with the element array buffer currently bound ; indexType is
+// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+void drawMeshlets(const MeshletDrawList & drawList, GLenum indexType);
+
+#endif
@@ -0,0 +1,265 @@
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "meshoptimizer.hpp"
+
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int> & indices, size_t vertexCount, unsigned int cacheSize){
+	// A vertex is in the FIFO if it entered it less than cacheSize misses ago
+	std::vector<unsigned int> entered(vertexCount, 0);
+	unsigned int time = cacheSize + 1;
+	size_t misses = 0;
+	for (size_t i = 0; i < indices.size(); ++i){
+		unsigned int v = indices[i];
+		if (time - entered[v] > cacheSize){
+			entered[v] = time++;
+			++misses;
+		}
+	}
+	VertexCacheStats stats;
+	stats.acmr = indices.size() >= 3 ? (float)misses / (float)(indices.size() / 3) : 0.0f;
+	stats.atvr = vertexCount > 0 ? (float)misses / (float)vertexCount : 0.0f;
+	return stats;
+}
+
+namespace {
+
+// Scoring constants from Tom Forsyth, "Linear-Speed Vertex Cache Optimisation"
+const int FORSYTH_CACHE_SIZE = 32;
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+float forsythVertexScore(int cachePosition, unsigned int remainingTriangles){
+	if (remainingTriangles == 0)
+		return -1.0f;
+	float score = 0.0f;
+	if (cachePosition >= 0){
+		if (cachePosition < 3){
+			// The vertices of the last triangle get a fixed score, so the next triangle does not
+			// simply reuse its edge and make long thin strips
+			score = LAST_TRIANGLE_SCORE;
+		}else{
+			const float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+			score = powf(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+		}
+	}
+	// Vertices with few triangles left get a boost, to finish them off and free their cache slot
+	return score + VALENCE_BOOST_SCALE * powf((float)remainingTriangles, -VALENCE_BOOST_POWER);
+}
+
+} // namespace
+
+void buildTriangleAdjacency(TriangleAdjacency & adjacency, const std::vector<unsigned int> & indices, size_t vertexCount){
+	adjacency.counts.assign(vertexCount, 0);
+	for (size_t i = 0; i < indices.size(); ++i)
+		++adjacency.counts[indices[i]];
+	adjacency.offsets.resize(vertexCount);
+	unsigned int offset = 0;
+	for (size_t v = 0; v < vertexCount; ++v){
+		adjacency.offsets[v] = offset;
+		offset += adjacency.counts[v];
+	}
+	adjacency.triangles.resize(indices.size());
+	std::vector<unsigned int> filled(vertexCount, 0);
+	for (size_t i = 0; i < indices.size(); ++i){
+		unsigned int v = indices[i];
+		adjacency.triangles[adjacency.offsets[v] + filled[v]++] = (unsigned int)(i / 3);
+	}
+}
+
+void optimizeVertexCache(std::vector<unsigned int> & indices, size_t vertexCount){
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	// counts[v] is the number of triangles of v not emitted yet ; they are kept at the front of its list
+	TriangleAdjacency adjacency;
+	buildTriangleAdjacency(adjacency, indices, vertexCount);
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v)
+		vertexScore[v] = forsythVertexScore(-1, adjacency.counts[v]);
+	std::vector<char> emitted(triangleCount, 0);
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	unsigned int cache[FORSYTH_CACHE_SIZE + 3];
+	int cacheCount = 0;
+	size_t deadEndCursor = 0;
+	long long best = -1;
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount){
+		if (best < 0){
+			// Nothing in the cache has triangles left : continue with the next triangle in input order
+			while (emitted[deadEndCursor]) ++deadEndCursor;
+			best = (long long)deadEndCursor;
+		}
+		const unsigned int * triangle = &indices[3 * (size_t)best];
+		emitted[(size_t)best] = 1;
+		result.insert(result.end(), triangle, triangle + 3);
+
+		// Remove the triangle from the lists of its vertices
+		for (int k = 0; k < 3; ++k){
+			unsigned int v = triangle[k];
+			unsigned int * list = &adjacency.triangles[adjacency.offsets[v]];
+			unsigned int & count = adjacency.counts[v];
+			for (unsigned int j = 0; j < count; ++j){
+				if (list[j] == (unsigned int)best){
+					list[j] = list[count - 1];
+					--count;
+					break;
+				}
+			}
+		}
+
+		// Move the triangle's vertices to the front of the LRU cache
+		unsigned int newCache[FORSYTH_CACHE_SIZE + 3];
+		int newCount = 0;
+		for (int k = 0; k < 3; ++k)
+			newCache[newCount++] = triangle[k];
+		for (int c = 0; c < cacheCount; ++c){
+			unsigned int v = cache[c];
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+				newCache[newCount++] = v;
+		}
+		for (int c = 0; c < newCount; ++c){
+			unsigned int v = newCache[c];
+			cachePosition[v] = (c < FORSYTH_CACHE_SIZE) ? c : -1;
+			vertexScore[v] = forsythVertexScore(cachePosition[v], adjacency.counts[v]);
+		}
+
+		// Score the triangles around every vertex whose score changed, and continue with the best
+		// one using a cached vertex
+		best = -1;
+		float bestScore = -1.0f;
+		for (int c = 0; c < newCount; ++c){
+			unsigned int v = newCache[c];
+			const unsigned int * list = &adjacency.triangles[adjacency.offsets[v]];
+			for (unsigned int j = 0; j < adjacency.counts[v]; ++j){
+				unsigned int t = list[j];
+				float score = vertexScore[indices[3 * t]] + vertexScore[indices[3 * t + 1]] + vertexScore[indices[3 * t + 2]];
+				if (c < FORSYTH_CACHE_SIZE && score > bestScore){
+					bestScore = score;
+					best = t;
+				}
+			}
+		}
+
+		cacheCount = std::min(newCount, FORSYTH_CACHE_SIZE);
+		std::copy(newCache, newCache + cacheCount, cache);
+	}
+	indices.swap(result);
+}
+
+void optimizeOverdraw(std::vector<unsigned int> & indices, const std::vector<glm::vec3> & positions, float threshold){
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+	const unsigned int cacheSize = 16;
+	const float meshACMR = analyzeVertexCache(indices, positions.size(), cacheSize).acmr;
+
+	// Cut the triangle order into clusters, at triangles that miss the cache on all 3 vertices
+	std::vector<size_t> clusterStart;
+	std::vector<unsigned int> entered(positions.size(), 0);
+	unsigned int time = cacheSize + 1;
+	size_t clusterMisses = 0, clusterTriangles = 0;
+	for (size_t t = 0; t < triangleCount; ++t){
+		int misses = 0;
+		for (int k = 0; k < 3; ++k){
+			unsigned int v = indices[3 * t + k];
+			if (time - entered[v] > cacheSize){
+				entered[v] = time++;
+				++misses;
+			}
+		}
+		if (t == 0 || (misses == 3 && clusterMisses <= threshold * meshACMR * clusterTriangles)){
+			clusterStart.push_back(t);
+			clusterMisses = clusterTriangles = 0;
+		}
+		clusterMisses += misses;
+		++clusterTriangles;
+	}
+	clusterStart.push_back(triangleCount);
+	const size_t clusterCount = clusterStart.size() - 1;
+
+	// Area-weighted centroid and normal of every cluster, and centroid of the mesh
+	std::vector<glm::vec3> clusterCentroid(clusterCount), clusterNormal(clusterCount);
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	for (size_t c = 0; c < clusterCount; ++c){
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; ++t){
+			const glm::vec3 & p0 = positions[indices[3 * t]];
+			const glm::vec3 & p1 = positions[indices[3 * t + 1]];
+			const glm::vec3 & p2 = positions[indices[3 * t + 2]];
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0); // Length is twice the area
+			float a = glm::length(n);
+			centroid += (p0 + p1 + p2) * (a / 3.0f);
+			normal += n;
+			area += a;
+		}
+		meshCentroid += centroid;
+		meshArea += area;
+		clusterCentroid[c] = area > 0.0f ? centroid / area : centroid;
+		float length = glm::length(normal);
+		clusterNormal[c] = length > 0.0f ? normal / length : normal;
+	}
+	if (meshArea > 0.0f)
+		meshCentroid /= meshArea;
+
+	// Clusters far out and facing away from the center come first : from most viewpoints they are
+	// in front of the rest of the mesh
+	std::vector<float> sortKey(clusterCount);
+	std::vector<size_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; ++c){
+		sortKey[c] = glm::dot(clusterCentroid[c] - meshCentroid, clusterNormal[c]);
+		order[c] = c;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){ return sortKey[a] > sortKey[b]; });
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	for (size_t i = 0; i < clusterCount; ++i){
+		size_t c = order[i];
+		result.insert(result.end(), indices.begin() + 3 * clusterStart[c], indices.begin() + 3 * clusterStart[c + 1]);
+	}
+	indices.swap(result);
+}
+
+std::vector<unsigned int> optimizeVertexFetch(std::vector<unsigned int> & indices, size_t vertexCount){
+	std::vector<unsigned int> remap(vertexCount, ~0u);
+	unsigned int next = 0;
+	for (size_t i = 0; i < indices.size(); ++i){
+		unsigned int & v = indices[i];
+		if (remap[v] == ~0u)
+			remap[v] = next++;
+		v = remap[v];
+	}
+	return remap;
+}
+
+void optimizeMesh(
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals
+){
+	VertexCacheStats before = analyzeVertexCache(indices, vertices.size());
+
+	optimizeVertexCache(indices, vertices.size());
+	optimizeOverdraw(indices, vertices);
+	std::vector<unsigned int> remap = optimizeVertexFetch(indices, vertices.size());
+	remapVertexStream(vertices, remap);
+	if (!uvs.empty()) remapVertexStream(uvs, remap);
+	if (!normals.empty()) remapVertexStream(normals, remap);
+
+	VertexCacheStats after = analyzeVertexCache(indices, vertices.size());
+	printf("Mesh optimized : ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", before.acmr, after.acmr, before.atvr, after.atvr);
+}
@@ -0,0 +1,61 @@
+#ifndef MESHOPTIMIZER_HPP
+#define MESHOPTIMIZER_HPP
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Reordering passes for indexed triangle lists (3 indices per triangle), to run after indexing.
+// None of them changes the rendered image, only the order in which the GPU gets the work.
+
+// Post-transform cache efficiency of an index buffer, measured on a simulated FIFO cache
+struct VertexCacheStats {
+	float acmr;   // Average cache miss ratio : vertex shader runs per triangle (0.5 best, 3 worst)
+	float atvr;   // Average transformed vertex ratio : vertex shader runs per vertex (1 best)
+};
+
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int> & indices, size_t vertexCount, unsigned int cacheSize = 16);
+
+// Reorders the triangles for vertex cache locality (Tom Forsyth's linear-speed algorithm)
+void optimizeVertexCache(std::vector<unsigned int> & indices, size_t vertexCount);
+
+// View-independent overdraw reduction : cuts the (cache-optimized) triangle order into clusters and
+// draws the clusters that face outward from the mesh center first, so they tend to occlude the
+// others. A cluster only ends where the cache was going to miss anyway and its own ACMR is within
+// threshold times the whole mesh's, which bounds the cache cost of the reordering.
+void optimizeOverdraw(std::vector<unsigned int> & indices, const std::vector<glm::vec3> & positions, float threshold = 1.05f);
+
+// Renumbers the vertices in order of first use so vertex fetch walks memory linearly.
+// Rewrites indices and returns the remap table (old index -> new one, ~0u for unused vertices) ;
+// apply it to every vertex stream with remapVertexStream.
+std::vector<unsigned int> optimizeVertexFetch(std::vector<unsigned int> & indices, size_t vertexCount);
+
+template <typename T>
+void remapVertexStream(std::vector<T> & stream, const std::vector<unsigned int> & remap){
+	size_t newCount = 0;
+	for (size_t i = 0; i < remap.size(); ++i)
+		if (remap[i] != ~0u && remap[i] + 1 > newCount) newCount = remap[i] + 1;
+	std::vector<T> remapped(newCount);
+	for (size_t i = 0; i < remap.size() && i < stream.size(); ++i)
+		if (remap[i] != ~0u) remapped[remap[i]] = stream[i];
+	stream.swap(remapped);
+}
+
+// Triangles using each vertex : triangles[offsets[v] .. offsets[v] + counts[v])
+struct TriangleAdjacency {
+	std::vector<unsigned int> offsets;
+	std::vector<unsigned int> counts;
+	std::vector<unsigned int> triangles;
+};
+
+void buildTriangleAdjacency(TriangleAdjacency & adjacency, const std::vector<unsigned int> & indices, size_t vertexCount);
+
+// Runs the three passes above, in order, on an indexed mesh (uvs / normals may be empty)
+// and prints the ACMR / ATVR before and after
+void optimizeMesh(
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals
+);
+
+#endif
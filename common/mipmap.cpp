@@ -0,0 +1,287 @@
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIPMAP_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "mipmap.hpp"
+#include "mappedfile.hpp"
+#include "parallel.hpp"
+
+namespace {
+
+const float KAISER_RADIUS = 3.0f;   // In destination texels
+const float KAISER_ALPHA = 4.0f;
+// Entries of the linear float -> sRGB byte table : steps of 1/16383 stay under a quarter of a byte
+// step even where the sRGB curve is steepest
+const int SRGB_ENCODE_TABLE_SIZE = 16384;
+// Rows per parallel block
+const size_t MIN_ROW_BLOCK = 16;
+
+float srgbToLinear(float c){
+	return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+float linearToSrgb(float c){
+	return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+}
+
+struct SrgbTables {
+	float decode[256];
+	unsigned char encode[SRGB_ENCODE_TABLE_SIZE];
+	SrgbTables(){
+		for (int i = 0; i < 256; ++i)
+			decode[i] = srgbToLinear(i / 255.0f);
+		for (int i = 0; i < SRGB_ENCODE_TABLE_SIZE; ++i)
+			encode[i] = (unsigned char)(linearToSrgb(i / (float)(SRGB_ENCODE_TABLE_SIZE - 1)) * 255.0f + 0.5f);
+	}
+};
+
+const SrgbTables & srgbTables(){
+	static const SrgbTables tables;   // Thread-safe initialization since C++11
+	return tables;
+}
+
+// Modified Bessel function of the first kind, order 0 (power series)
+double besselI0(double x){
+	double sum = 1.0, term = 1.0;
+	for (int k = 1; k < 30; ++k){
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+	return sum;
+}
+
+double sinc(double x){
+	const double pi = 3.14159265358979323846;
+	return fabs(x) < 1e-9 ? 1.0 : sin(pi * x) / (pi * x);
+}
+
+// Weights of the source texels of every destination texel along one axis : tapCount taps each,
+// source indices already clamped to the edge
+struct AxisFilter {
+	size_t tapCount;
+	std::vector<int> indices;
+	std::vector<float> weights;
+};
+
+void buildAxisFilter(AxisFilter & axis, unsigned int sourceSize, unsigned int destinationSize, MipFilter filter){
+	const double scale = (double)sourceSize / destinationSize;
+	const double support = (filter == MIP_FILTER_BOX) ? 0.5 * scale : KAISER_RADIUS * scale;
+	std::vector<std::vector<std::pair<int, float> > > taps(destinationSize);
+	size_t tapCount = 1;
+	for (unsigned int x = 0; x < destinationSize; ++x){
+		const double center = (x + 0.5) * scale;
+		double total = 0.0;
+		for (int i = (int)floor(center - support); i <= (int)ceil(center + support); ++i){
+			double weight;
+			if (filter == MIP_FILTER_BOX){
+				// Overlap of source texel [i, i + 1] with the destination footprint
+				weight = std::min(i + 1.0, center + support) - std::max((double)i, center - support);
+			}else{
+				double d = (i + 0.5 - center) / scale;
+				double r = d / KAISER_RADIUS;
+				weight = fabs(r) < 1.0 ? sinc(d) * besselI0(KAISER_ALPHA * sqrt(1.0 - r * r)) / besselI0(KAISER_ALPHA) : 0.0;
+			}
+			if (weight == 0.0 || (filter == MIP_FILTER_BOX && weight < 0.0))
+				continue;
+			int clamped = i < 0 ? 0 : (i >= (int)sourceSize ? (int)sourceSize - 1 : i);
+			taps[x].push_back(std::make_pair(clamped, (float)weight));
+			total += weight;
+		}
+		for (size_t t = 0; t < taps[x].size(); ++t)
+			taps[x][t].second = (float)(taps[x][t].second / total);
+		tapCount = std::max(tapCount, taps[x].size());
+	}
+	// Same tap count everywhere, padded with zero weights, so the inner loops have a fixed length
+	axis.tapCount = tapCount;
+	axis.indices.assign(destinationSize * tapCount, 0);
+	axis.weights.assign(destinationSize * tapCount, 0.0f);
+	for (unsigned int x = 0; x < destinationSize; ++x){
+		for (size_t t = 0; t < taps[x].size(); ++t){
+			axis.indices[x * tapCount + t] = taps[x][t].first;
+			axis.weights[x * tapCount + t] = taps[x][t].second;
+		}
+	}
+}
+
+// destination (4 floats) = sum of weights[t] * texel(t) ; texels are 4 floats, stride floats apart
+inline void filterTexel(float * destination, const float * source, size_t stride, const int * indices, const float * weights, size_t tapCount){
+#ifdef MIPMAP_SSE2
+	__m128 sum = _mm_setzero_ps();
+	for (size_t t = 0; t < tapCount; ++t)
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(source + indices[t] * stride), _mm_set1_ps(weights[t])));
+	_mm_storeu_ps(destination, sum);
+#else
+	float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (size_t t = 0; t < tapCount; ++t){
+		const float * texel = source + indices[t] * stride;
+		for (int c = 0; c < 4; ++c)
+			sum[c] += texel[c] * weights[t];
+	}
+	memcpy(destination, sum, sizeof(sum));
+#endif
+}
+
+inline unsigned char encodeLinear(float v){
+	v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+	return (unsigned char)(v * 255.0f + 0.5f);
+}
+
+inline unsigned char encodeSrgb(float v){
+	v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+	return srgbTables().encode[(int)(v * (SRGB_ENCODE_TABLE_SIZE - 1) + 0.5f)];
+}
+
+// Cache file : MipCacheHeader, then MipChain::data
+const char MIP_CACHE_MAGIC[8] = { 'M', 'I', 'P', 'C', 'H', 'A', 'I', 'N' };
+const uint32_t MIP_CACHE_VERSION = 1;
+
+struct MipCacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t levelCount;
+	uint32_t width;
+	uint32_t height;
+	uint64_t key;
+	uint64_t dataSize;
+};
+
+static_assert(sizeof(MipCacheHeader) == 40, "MipCacheHeader must be tightly packed");
+
+void computeLevelOffsets(MipChain & chain){
+	chain.levelOffsets.clear();
+	size_t offset = 0;
+	for (size_t level = 0; ; ++level){
+		chain.levelOffsets.push_back(offset);
+		offset += (size_t)chain.levelWidth(level) * chain.levelHeight(level) * 4;
+		if (chain.levelWidth(level) == 1 && chain.levelHeight(level) == 1)
+			break;
+	}
+	chain.levelOffsets.push_back(offset);
+}
+
+} // namespace
+
+void generateMipChain(const unsigned char * pixels, unsigned int width, unsigned int height,
+	MipFilter filter, bool srgb, MipChain & chain){
+	chain.width = width;
+	chain.height = height;
+	computeLevelOffsets(chain);
+	chain.data.resize(chain.levelOffsets.back());
+	memcpy(&chain.data[0], pixels, (size_t)width * height * 4);
+	const SrgbTables & tables = srgbTables();
+
+	// Level 0 in float, linear
+	std::vector<float> current((size_t)width * height * 4), temporary, next;
+	parallelForBlocks(height, MIN_ROW_BLOCK, [&](size_t begin, size_t end){
+		for (size_t i = begin * width * 4; i < end * width * 4; ++i)
+			current[i] = (srgb && i % 4 != 3) ? tables.decode[pixels[i]] : pixels[i] / 255.0f;
+	});
+
+	AxisFilter horizontal, vertical;
+	for (size_t level = 1; level < chain.levelCount(); ++level){
+		const unsigned int sourceWidth = chain.levelWidth(level - 1), sourceHeight = chain.levelHeight(level - 1);
+		const unsigned int w = chain.levelWidth(level), h = chain.levelHeight(level);
+		buildAxisFilter(horizontal, sourceWidth, w, filter);
+		buildAxisFilter(vertical, sourceHeight, h, filter);
+
+		// Separable : filter the rows to the new width, then the columns to the new height
+		temporary.resize((size_t)sourceHeight * w * 4);
+		parallelForBlocks(sourceHeight, MIN_ROW_BLOCK, [&](size_t begin, size_t end){
+			for (size_t y = begin; y < end; ++y){
+				const float * sourceRow = &current[y * sourceWidth * 4];
+				float * row = &temporary[y * w * 4];
+				for (unsigned int x = 0; x < w; ++x)
+					filterTexel(row + 4 * x, sourceRow, 4, &horizontal.indices[x * horizontal.tapCount],
+						&horizontal.weights[x * horizontal.tapCount], horizontal.tapCount);
+			}
+		});
+		next.resize((size_t)h * w * 4);
+		unsigned char * out = &chain.data[chain.levelOffsets[level]];
+		parallelForBlocks(h, MIN_ROW_BLOCK, [&](size_t begin, size_t end){
+			for (size_t y = begin; y < end; ++y){
+				float * row = &next[y * w * 4];
+				for (unsigned int x = 0; x < w; ++x)
+					filterTexel(row + 4 * x, &temporary[x * 4], (size_t)w * 4, &vertical.indices[y * vertical.tapCount],
+						&vertical.weights[y * vertical.tapCount], vertical.tapCount);
+				for (size_t i = 0; i < (size_t)w * 4; ++i)
+					out[y * w * 4 + i] = (srgb && i % 4 != 3) ? encodeSrgb(row[i]) : encodeLinear(row[i]);
+			}
+		});
+		current.swap(next);
+	}
+}
+
+uint64_t mipChainKey(const unsigned char * pixels, unsigned int width, unsigned int height, MipFilter filter, bool srgb){
+	uint64_t settings = ((uint64_t)width << 32) ^ ((uint64_t)height << 2) ^ ((uint64_t)filter << 1) ^ (srgb ? 1 : 0);
+	return hashBytes(pixels, (size_t)width * height * 4, settings);
+}
+
+bool saveMipChain(const char * path, uint64_t key, const MipChain & chain){
+	MipCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MIP_CACHE_MAGIC, sizeof(header.magic));
+	header.version = MIP_CACHE_VERSION;
+	header.levelCount = (uint32_t)chain.levelCount();
+	header.width = chain.width;
+	header.height = chain.height;
+	header.key = key;
+	header.dataSize = chain.data.size();
+
+	// Two loaders saving the same chain each write their own temporary file
+	std::vector<FileChunk> chunks;
+	FileChunk headerChunk = { &header, sizeof(header) };
+	FileChunk dataChunk = { chain.data.data(), chain.data.size() };
+	chunks.push_back(headerChunk);
+	chunks.push_back(dataChunk);
+	return writeFileReplacing(path, chunks);
+}
+
+bool loadMipChain(const char * path, uint64_t key, MipChain & chain){
+	MappedFile file;
+	if (!file.open(path))
+		return false;
+	MipCacheHeader header;
+	if (file.size() < sizeof(header))
+		return false;
+	memcpy(&header, file.data(), sizeof(header));
+	if (memcmp(header.magic, MIP_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != MIP_CACHE_VERSION || header.key != key)
+		return false;
+	chain.width = header.width;
+	chain.height = header.height;
+	computeLevelOffsets(chain);
+	if (header.levelCount != chain.levelCount() || header.dataSize != chain.levelOffsets.back() ||
+		file.size() - sizeof(header) < header.dataSize)
+		return false;
+	chain.data.assign(file.data() + sizeof(header), file.data() + sizeof(header) + header.dataSize);
+	return true;
+}
+
+void loadOrGenerateMipChain(const char * cachePath, const unsigned char * pixels, unsigned int width, unsigned int height,
+	MipFilter filter, bool srgb, MipChain & chain){
+	const uint64_t key = mipChainKey(pixels, width, height, filter, srgb);
+	if (loadMipChain(cachePath, key, chain))
+		return;
+	generateMipChain(pixels, width, height, filter, srgb, chain);
+	if (!saveMipChain(cachePath, key, chain))
+		printf("Could not write mip cache %s\n", cachePath);
+}
+
+void uploadMipChain(const MipChain & chain, GLenum format, bool srgb){
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	for (size_t level = 0; level < chain.levelCount(); ++level)
+		glTexImage2D(GL_TEXTURE_2D, (GLint)level, srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8, chain.levelWidth(level), chain.levelHeight(level),
+			0, format, GL_UNSIGNED_BYTE, chain.level(level));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)chain.levelCount() - 1);
+}
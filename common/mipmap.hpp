@@ -0,0 +1,54 @@
+#ifndef MIPMAP_HPP
+#define MIPMAP_HPP
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <GL/glew.h>
+
+// Mip chains built on the CPU, instead of glGenerateMipmap : same result on every driver, a
+// choice of filter, and no stall in the driver at load time.
+// Images are 8 bits x 4 channels, in any channel order (RGBA, BGRA) ; the 4th channel is alpha.
+
+enum MipFilter {
+	MIP_FILTER_BOX,      // Average of the source texels under each texel (2x2 for even sizes)
+	MIP_FILTER_KAISER    // Kaiser-windowed sinc (radius 3, alpha 4) : sharper, less aliasing
+};
+
+struct MipChain {
+	unsigned int width, height;          // Of level 0
+	std::vector<unsigned char> data;     // Every level, rows tightly packed, level 0 first
+	std::vector<size_t> levelOffsets;    // Start of every level in data, plus the end
+
+	size_t levelCount() const { return levelOffsets.empty() ? 0 : levelOffsets.size() - 1; }
+	unsigned int levelWidth(size_t level) const { return width >> level > 0 ? width >> level : 1; }
+	unsigned int levelHeight(size_t level) const { return height >> level > 0 ? height >> level : 1; }
+	const unsigned char * level(size_t level) const { return &data[levelOffsets[level]]; }
+};
+
+// Builds every level down to 1x1, each one filtered from the previous in float. With srgb, the
+// color channels are filtered in linear space (decoded, filtered, re-encoded), which keeps
+// the brightness of high-contrast textures ; alpha is always linear. Rows are spread over
+// workerThreadCount() threads, with one SIMD register per texel when SSE2 is there.
+void generateMipChain(const unsigned char * pixels, unsigned int width, unsigned int height,
+	MipFilter filter, bool srgb, MipChain & chain);
+
+// Identifies a chain by its source pixels and settings, for the cache below
+uint64_t mipChainKey(const unsigned char * pixels, unsigned int width, unsigned int height, MipFilter filter, bool srgb);
+
+// Binary cache file of a chain. loadMipChain fails if the file is missing, damaged or was
+// written for another key.
+bool saveMipChain(const char * path, uint64_t key, const MipChain & chain);
+bool loadMipChain(const char * path, uint64_t key, MipChain & chain);
+
+// Reads the chain from cachePath if it is there for these pixels and settings ; otherwise
+// generates it and writes cachePath for the next time.
+void loadOrGenerateMipChain(const char * cachePath, const unsigned char * pixels, unsigned int width, unsigned int height,
+	MipFilter filter, bool srgb, MipChain & chain);
+
+// glTexImage2D of every level into the texture bound to GL_TEXTURE_2D. format is GL_RGBA or
+// GL_BGRA ; srgb selects GL_SRGB8_ALPHA8 storage.
+void uploadMipChain(const MipChain & chain, GLenum format, bool srgb);
+
+#endif
@@ -2,10 +2,19 @@
 #include <stdio.h>
 #include <string>
 #include <cstring>
+#include <cstdint>
+#include <functional>
+#include <atomic>
+#include <stdlib.h>
 
 #include <glm/glm.hpp>
 
 #include "objloader.hpp"
+#include "mappedfile.hpp"
+#include "fastparse.hpp"
+#include "parallel.hpp"
+#include "hashtable.hpp"
+#include "vertexnormals.hpp"
 
 // Very, VERY simple OBJ loader.
 // Here is a short list of features a real function would provide : 
@@ -17,84 +26,873 @@
 // - More secure. Change another line and you can inject code.
 // - Loading from memory, stream, etc
 
-bool loadOBJ(
-	const char * path, 
-	std::vector<glm::vec3> & out_vertices, 
+// The file is memory-mapped and walked line by line (SSE2 newline search) in two passes :
+// 1. count the lines of each kind and the triangle corners of the faces, so every array is
+//    allocated exactly once
+// 2. parse the "v", "vt" and "vn" lines into the attribute arrays and the "f" lines into
+//    triangle corners (attribute indices, n-gons fan-triangulated)
+// Face indices only need the attribute counts, never the attributes themselves, so both kinds of
+// lines are handled in the same pass.
+// Big files are cut into chunks at line boundaries and every pass runs on all chunks in parallel.
+// A prefix sum over the per-chunk counts of pass 1 tells each chunk where its attributes, face
+// corners and line numbers start (and how many attributes precede it, for negative indices), so
+// the chunks write disjoint ranges of the final arrays and the result is exactly the one of a
+// serial load.
+// All counts are size_t, so files larger than 4GB are fine on 64-bit builds.
+
+namespace {
+
+enum ObjLineType { OBJ_OTHER, OBJ_POSITION, OBJ_UV, OBJ_NORMAL, OBJ_FACE };
+
+struct ObjCounts {
+	size_t lines;
+	size_t positions;
+	size_t uvs;
+	size_t normals;
+	size_t corners;
+};
+
+// Attribute indices of one triangle corner, 0-based
+const uint32_t OBJ_NO_INDEX = 0xFFFFFFFFu;   // The face has no such attribute
+
+struct ObjCorner {
+	uint32_t position;
+	uint32_t uv;
+	uint32_t normal;
+};
+
+inline bool operator==(const ObjCorner & a, const ObjCorner & b){
+	return a.position == b.position && a.uv == b.uv && a.normal == b.normal;
+}
+
+// Everything an OBJ file contains that we use, with the faces as a triangle list
+struct ObjContents {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	std::vector<ObjCorner> corners;   // 3 per triangle
+};
+
+struct ObjError {
+	size_t line;          // 1-based, 0 if no error
+	const char * message;
+};
+
+// Reads the keyword at the start of a line and leaves p on its first argument
+ObjLineType classifyObjLine(const char * & p, const char * end){
+	p = skipBlankChars(p, end);
+	if (p == end)
+		return OBJ_OTHER;
+	ObjLineType type;
+	const char * q = p;
+	if (q[0] == 'v'){
+		if (end - q >= 2 && q[1] == 'n'){ type = OBJ_NORMAL; q += 2; }
+		else if (end - q >= 2 && q[1] == 't'){ type = OBJ_UV; q += 2; }
+		else { type = OBJ_POSITION; q += 1; }
+	}else if (q[0] == 'f'){
+		type = OBJ_FACE; q += 1;
+	}else{
+		return OBJ_OTHER;
+	}
+	// The keyword must be a whole word ("vp", "fo"... are something else)
+	if (q != end && !isSpaceChar(*q))
+		return OBJ_OTHER;
+	p = skipBlankChars(q, end);
+	return type;
+}
+
+// True if only blanks or a comment remain on the line
+bool atLineEnd(const char * p, const char * end){
+	p = skipBlankChars(p, end);
+	return p == end || *p == '\n' || *p == '#';
+}
+
+// None of the parsers below skip newlines, so they never run past the current line
+const char * parseVec3(const char * p, const char * end, glm::vec3 & v){
+	for (int k = 0; k < 3; ++k){
+		p = parseFloat(skipBlankChars(p, end), end, v[k]);
+		if (p == NULL)
+			return NULL;
+	}
+	return p;
+}
+
+// "vt u v [w]" : w is ignored
+const char * parseVec2(const char * p, const char * end, glm::vec2 & v){
+	for (int k = 0; k < 2; ++k){
+		p = parseFloat(skipBlankChars(p, end), end, v[k]);
+		if (p == NULL)
+			return NULL;
+	}
+	return p;
+}
+
+// Number of corners of a face line, without parsing them. Leaves p at the end of the line.
+size_t countFaceCorners(const char * & p, const char * end){
+	size_t corners = 0;
+	for (;;){
+		p = skipBlankChars(p, end);
+		if (p == end || *p == '\n' || *p == '#')
+			return corners;
+		++corners;
+		while (p != end && !isSpaceChar(*p) && *p != '#') ++p;
+	}
+}
+
+// One face corner : "v", "v/vt", "v//vn" or "v/vt/vn", 1-based or negative (relative) indices.
+// Missing indices are left at 0, which is not a valid index.
+const char * parseFaceCorner(const char * p, const char * end, long long index[3]){
+	index[0] = index[1] = index[2] = 0;
+	p = parseInt(p, end, index[0]);
+	if (p == NULL || index[0] == 0)
+		return NULL;
+	if (p == end || *p != '/')
+		return p;
+	++p;
+	if (p == end)
+		return NULL;
+	if (*p != '/'){
+		p = parseInt(p, end, index[1]);
+		if (p == NULL || index[1] == 0)
+			return NULL;
+		if (p == end || *p != '/')
+			return p;
+	}
+	p = parseInt(p + 1, end, index[2]);
+	if (p == NULL || index[2] == 0)
+		return NULL;
+	return p;
+}
+
+// Turns a 1-based or negative OBJ index into a 0-based one. `before` is the number of attributes
+// of this kind read before the current line, `total` the number in the whole file.
+bool resolveObjIndex(long long index, size_t before, size_t total, uint32_t & out){
+	if (index == 0){
+		out = OBJ_NO_INDEX;
+		return true;
+	}
+	if (index > 0){
+		if ((unsigned long long)index > total)
+			return false;
+		out = (uint32_t)(index - 1);
+	}else{
+		if ((unsigned long long)(-(index + 1)) >= before)
+			return false;
+		out = (uint32_t)(before - (size_t)(-(index + 1)) - 1);
+	}
+	return true;
+}
+
+// Calls f(type, arguments) for every line of [begin, end). f returns where it stopped reading
+// (the rest of the line is skipped from there), or NULL to abort.
+template <typename F>
+void forEachObjLine(const char * begin, const char * end, F f){
+	const char * line = begin;
+	while (line < end){
+		const char * p = line;
+		ObjLineType type = classifyObjLine(p, end);
+		p = f(type, p);
+		if (p == NULL)
+			return;
+		const char * lineEnd = findNewline(p, end);
+		if (lineEnd == end)
+			return;
+		line = lineEnd + 1;
+	}
+}
+
+// Pass 1
+void countObjLines(const char * begin, const char * end, ObjCounts & counts){
+	memset(&counts, 0, sizeof(counts));
+	forEachObjLine(begin, end, [&](ObjLineType type, const char * p){
+		++counts.lines;
+		if (type == OBJ_POSITION) ++counts.positions;
+		else if (type == OBJ_UV) ++counts.uvs;
+		else if (type == OBJ_NORMAL) ++counts.normals;
+		else if (type == OBJ_FACE){
+			// A polygon of n corners is a fan of n - 2 triangles. Faces with less than 3 corners
+			// are counted as nothing and rejected by pass 2.
+			size_t n = countFaceCorners(p, end);
+			if (n >= 3) counts.corners += 3 * (n - 2);
+		}
+		return p;
+	});
+}
+
+// Pass 2 : attributes and triangle corners of one chunk are written from `first` onward.
+// `first` also holds the number of attributes in the previous chunks, for negative indices.
+bool parseObjChunk(const char * begin, const char * end, const ObjCounts & first, const ObjCounts & total,
+	ObjContents & contents, ObjError & error){
+	size_t line = first.lines + 1;
+	size_t positions = first.positions, uvs = first.uvs, normals = first.normals;
+	ObjCorner * corners = contents.corners.data() + first.corners;
+	std::vector<ObjCorner> polygon;
+	bool ok = true;
+	auto fail = [&](const char * message) -> const char * {
+		error.line = line;
+		error.message = message;
+		ok = false;
+		return NULL;
+	};
+	forEachObjLine(begin, end, [&](ObjLineType type, const char * p) -> const char * {
+		if (type == OBJ_POSITION){
+			p = parseVec3(p, end, contents.positions[positions++]);
+		}else if (type == OBJ_UV){
+			p = parseVec2(p, end, contents.uvs[uvs++]);
+		}else if (type == OBJ_NORMAL){
+			p = parseVec3(p, end, contents.normals[normals++]);
+		}else if (type == OBJ_FACE){
+			polygon.clear();
+			while (!atLineEnd(p, end)){
+				long long index[3];
+				p = parseFaceCorner(skipBlankChars(p, end), end, index);
+				if (p == NULL || (p != end && !isSpaceChar(*p) && *p != '#'))
+					return fail("File can't be read by our simple parser :-( Try exporting with other options");
+				ObjCorner corner;
+				if (!resolveObjIndex(index[0], positions, total.positions, corner.position) ||
+					!resolveObjIndex(index[1], uvs, total.uvs, corner.uv) ||
+					!resolveObjIndex(index[2], normals, total.normals, corner.normal))
+					return fail("face index out of range");
+				polygon.push_back(corner);
+			}
+			if (polygon.size() < 3)
+				return fail("face with less than 3 vertices");
+			for (size_t k = 1; k + 1 < polygon.size(); ++k){
+				*corners++ = polygon[0];
+				*corners++ = polygon[k];
+				*corners++ = polygon[k + 1];
+			}
+		}
+		if (p == NULL)
+			return fail(type == OBJ_UV ? "expected two numbers" : "expected three numbers");
+		++line;
+		return p;
+	});
+	return ok;
+}
+
+// Chunks are large enough that the per-chunk bookkeeping is negligible
+const size_t OBJ_MIN_CHUNK_SIZE = 4 << 20;
+
+// Cuts [begin, end) into pieces that each start at the beginning of a line
+std::vector<const char *> splitObjChunks(const char * begin, const char * end){
+	const size_t size = (size_t)(end - begin);
+	const size_t chunkCount = parallelBlockCount(size, OBJ_MIN_CHUNK_SIZE);
+	std::vector<const char *> bounds;
+	bounds.push_back(begin);
+	for (size_t c = 1; c < chunkCount; ++c){
+		const char * p = begin + size * c / chunkCount;
+		if (p <= bounds.back())
+			continue;
+		p = findNewline(p - 1, end); // p - 1 : a chunk may start right after a newline
+		if (p == end || p + 1 == end)
+			break;
+		bounds.push_back(p + 1);
+	}
+	bounds.push_back(end);
+	return bounds;
+}
+
+// Reports the first error of the file, whichever chunk found it
+bool reportObjErrors(const char * path, const std::vector<ObjError> & errors){
+	for (size_t c = 0; c < errors.size(); ++c){
+		if (errors[c].message != NULL){
+			printf("%s:%zu: %s\n", path, errors[c].line, errors[c].message);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool readObjContents(const char * path, ObjContents & contents){
+	printf("Loading OBJ file %s...\n", path);
+
+	MappedFile file;
+	if (!file.open(path)){
+		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
+		return false;
+	}
+
+	const std::vector<const char *> bounds = splitObjChunks(file.begin(), file.end());
+	const size_t chunkCount = bounds.size() - 1;
+
+	// Pass 1, then exclusive prefix sums : chunk c starts at starts[c]
+	std::vector<ObjCounts> starts(chunkCount + 1);
+	parallelFor(chunkCount, [&](size_t c){
+		countObjLines(bounds[c], bounds[c + 1], starts[c + 1]);
+	});
+	memset(&starts[0], 0, sizeof(starts[0]));
+	for (size_t c = 1; c <= chunkCount; ++c){
+		starts[c].lines += starts[c - 1].lines;
+		starts[c].positions += starts[c - 1].positions;
+		starts[c].uvs += starts[c - 1].uvs;
+		starts[c].normals += starts[c - 1].normals;
+		starts[c].corners += starts[c - 1].corners;
+	}
+	const ObjCounts & counts = starts[chunkCount];
+	if (counts.positions >= OBJ_NO_INDEX || counts.uvs >= OBJ_NO_INDEX || counts.normals >= OBJ_NO_INDEX){
+		printf("%s: too many vertices for 32-bit indices\n", path);
+		return false;
+	}
+
+	contents.positions.resize(counts.positions);
+	contents.uvs.resize(counts.uvs);
+	contents.normals.resize(counts.normals);
+	contents.corners.resize(counts.corners);
+	std::vector<ObjError> errors(chunkCount);
+	parallelFor(chunkCount, [&](size_t c){
+		errors[c].message = NULL;
+		parseObjChunk(bounds[c], bounds[c + 1], starts[c], counts, contents, errors[c]);
+	});
+	return !reportObjErrors(path, errors);
+}
+
+// Minimum number of corners per parallel block when expanding or gathering vertices
+const size_t OBJ_MIN_CORNER_BLOCK = 1 << 16;
+
+// Edges sharper than this (in degrees) stay hard in the normals generated for faces without any
+const float OBJ_CREASE_ANGLE = 60.0f;
+
+} // namespace
+
+static bool parseOBJ(
+	const char * path,
+	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec3> & out_normals
 ){
-	printf("Loading OBJ file %s...\n", path);
+	ObjContents contents;
+	if (!readObjContents(path, contents))
+		return false;
+	const std::vector<ObjCorner> & corners = contents.corners;
+
+	// Faces without normals get smooth ones, computed from the positions
+	std::vector<glm::vec3> generatedNormals;
+	for (size_t i = 0; i < corners.size(); ++i){
+		if (corners[i].normal == OBJ_NO_INDEX){
+			std::vector<unsigned int> positionIndices(corners.size());
+			for (size_t j = 0; j < corners.size(); ++j)
+				positionIndices[j] = corners[j].position;
+			computeCornerNormals(positionIndices, contents.positions, OBJ_CREASE_ANGLE, generatedNormals);
+			break;
+		}
+	}
+
+	// Append, like repeated push_back would
+	const size_t vertexBase = out_vertices.size();
+	const size_t normalBase = out_normals.size();
+	out_vertices.resize(vertexBase + corners.size());
+	out_normals.resize(normalBase + corners.size());
+	parallelForBlocks(corners.size(), OBJ_MIN_CORNER_BLOCK, [&](size_t begin, size_t end){
+		for (size_t i = begin; i < end; ++i){
+			out_vertices[vertexBase + i] = contents.positions[corners[i].position];
+			out_normals[normalBase + i] = corners[i].normal != OBJ_NO_INDEX ? contents.normals[corners[i].normal] : generatedNormals[i];
+		}
+	});
+	return true;
+}
+
+bool loadOBJIndexed(
+	const char * path,
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	out_indices.clear();
+	out_vertices.clear();
+	out_uvs.clear();
+	out_normals.clear();
+
+	ObjContents contents;
+	if (!readObjContents(path, contents))
+		return false;
+	const std::vector<ObjCorner> & corners = contents.corners;
+	if (corners.size() >= OBJ_NO_INDEX){
+		printf("%s: too many vertices for 32-bit indices\n", path);
+		return false;
+	}
+
+	// Every distinct (v, vt, vn) combination becomes one vertex, numbered by first occurrence
+	size_t expected = contents.positions.size();
+	if (expected < contents.normals.size()) expected = contents.normals.size();
+	if (expected < contents.uvs.size()) expected = contents.uvs.size();
+	std::vector<ObjCorner> unique;
+	unique.reserve(expected);
+	IdHashTable table(expected);
+	out_indices.resize(corners.size());
+	bool anyUV = false, anyNormal = false;
+	for (size_t i = 0; i < corners.size(); ++i){
+		const ObjCorner & corner = corners[i];
+		const uint32_t words[3] = { corner.position, corner.uv, corner.normal };
+		const uint32_t newId = (uint32_t)unique.size();
+		const uint32_t id = table.findOrInsert(IdHashTable::hashWords(words, 3), newId,
+			[&](uint32_t candidate){ return unique[candidate] == corner; });
+		if (id == newId){
+			unique.push_back(corner);
+			anyUV = anyUV || corner.uv != OBJ_NO_INDEX;
+			anyNormal = anyNormal || corner.normal != OBJ_NO_INDEX;
+		}
+		out_indices[i] = id;
+	}
+
+	// Streams the file has no data for at all stay empty ; corners of faces that lack an
+	// attribute other faces have get zeros.
+	out_vertices.resize(unique.size());
+	if (anyUV) out_uvs.resize(unique.size());
+	if (anyNormal) out_normals.resize(unique.size());
+	parallelForBlocks(unique.size(), OBJ_MIN_CORNER_BLOCK, [&](size_t begin, size_t end){
+		for (size_t i = begin; i < end; ++i){
+			out_vertices[i] = contents.positions[unique[i].position];
+			if (anyUV && unique[i].uv != OBJ_NO_INDEX)
+				out_uvs[i] = contents.uvs[unique[i].uv];
+			if (anyNormal && unique[i].normal != OBJ_NO_INDEX)
+				out_normals[i] = contents.normals[unique[i].normal];
+		}
+	});
+	return true;
+}
 
-	std::vector<unsigned int> vertexIndices, normalIndices;
-	std::vector<glm::vec3> temp_vertices; 
-	std::vector<glm::vec3> temp_normals;
+// Streaming : the attributes are spilled to one binary file per kind (pass 1), which are then
+// memory-mapped for random access while the faces are read (pass 2). Both passes are serial reads
+// of the mapped OBJ file.
+namespace {
 
+// Size of the stdio buffer of each spill file
+const size_t OBJ_SPILL_BUFFER_SIZE = 1 << 20;
 
-	FILE * file = fopen(path, "r");
-	if( file == NULL ){
+struct ObjSpillFile {
+	std::string path;
+	FILE * file;
+};
+
+// Tries that many names before giving up on the scratch directory
+const unsigned int OBJ_SPILL_NAME_ATTEMPTS = 16;
+
+// The system temporary directory, so that assets may sit in read-only directories
+std::string defaultScratchDirectory(){
+	static const char * const variables[3] = { "TMPDIR", "TEMP", "TMP" };
+	for (int i = 0; i < 3; ++i){
+		const char * directory = getenv(variables[i]);
+		if (directory != NULL && directory[0] != '\0')
+			return directory;
+	}
+#ifdef _WIN32
+	return ".";
+#else
+	return "/tmp";
+#endif
+}
+
+// Creates the three files exclusively ("x") under fresh names, so that streams running at the
+// same time, in this process or another, never share a file
+bool openSpillFiles(const char * objPath, const char * scratchDirectory, ObjSpillFile spill[3]){
+	static const char * const suffixes[3] = { ".v.spill", ".vt.spill", ".vn.spill" };
+	static std::atomic<unsigned int> streamCounter(0);
+	const std::string directory = scratchDirectory != NULL ? std::string(scratchDirectory) : defaultScratchDirectory();
+	const uint64_t pathHash = hashBytes(objPath, strlen(objPath));
+	for (int k = 0; k < 3; ++k){
+		for (unsigned int attempt = 0; attempt < OBJ_SPILL_NAME_ATTEMPTS && spill[k].file == NULL; ++attempt){
+			char name[64];
+			snprintf(name, sizeof(name), "/obj%016llx-%u%s", (unsigned long long)pathHash, streamCounter++, suffixes[k]);
+			spill[k].path = directory + name;
+			spill[k].file = fopen(spill[k].path.c_str(), "wbx");
+		}
+		if (spill[k].file == NULL){
+			printf("Could not create a spill file in %s\n", directory.c_str());
+			spill[k].path.clear();
+			return false;
+		}
+		setvbuf(spill[k].file, NULL, _IOFBF, OBJ_SPILL_BUFFER_SIZE);
+	}
+	return true;
+}
+
+void removeSpillFiles(ObjSpillFile spill[3]){
+	for (int k = 0; k < 3; ++k){
+		if (spill[k].file != NULL)
+			fclose(spill[k].file);
+		spill[k].file = NULL;
+		if (!spill[k].path.empty())
+			remove(spill[k].path.c_str());
+	}
+}
+
+// Pass 1 : writes positions, uvs and normals to the spill files and counts them
+bool spillObjAttributes(const char * path, const char * begin, const char * end, ObjSpillFile spill[3], ObjCounts & counts){
+	memset(&counts, 0, sizeof(counts));
+	ObjError error = { 0, NULL };
+	forEachObjLine(begin, end, [&](ObjLineType type, const char * p) -> const char * {
+		++counts.lines;
+		bool written = true;
+		if (type == OBJ_POSITION || type == OBJ_NORMAL){
+			glm::vec3 v;
+			p = parseVec3(p, end, v);
+			if (p != NULL){
+				written = fwrite(&v, sizeof(v), 1, spill[type == OBJ_POSITION ? 0 : 2].file) == 1;
+				++(type == OBJ_POSITION ? counts.positions : counts.normals);
+			}
+		}else if (type == OBJ_UV){
+			glm::vec2 uv;
+			p = parseVec2(p, end, uv);
+			if (p != NULL){
+				written = fwrite(&uv, sizeof(uv), 1, spill[1].file) == 1;
+				++counts.uvs;
+			}
+		}
+		if (p == NULL || !written){
+			error.line = counts.lines;
+			error.message = (p == NULL) ? (type == OBJ_UV ? "expected two numbers" : "expected three numbers") : "could not write the spill file";
+			return NULL;
+		}
+		return p;
+	});
+	for (int k = 0; k < 3; ++k){
+		if (fclose(spill[k].file) != 0 && error.message == NULL)
+			error.message = "could not write the spill file";
+		spill[k].file = NULL;
+	}
+	if (error.message != NULL){
+		printf("%s:%zu: %s\n", path, error.line, error.message);
+		return false;
+	}
+	if (counts.positions >= OBJ_NO_INDEX || counts.uvs >= OBJ_NO_INDEX || counts.normals >= OBJ_NO_INDEX){
+		printf("%s: too many vertices for 32-bit indices\n", path);
+		return false;
+	}
+	return true;
+}
+
+} // namespace
+
+bool streamOBJ(
+	const char * path,
+	size_t trianglesPerChunk,
+	const std::function<bool(const ObjTriangleChunk &)> & onChunk,
+	const char * scratchDirectory
+){
+	printf("Streaming OBJ file %s...\n", path);
+	if (trianglesPerChunk == 0)
+		trianglesPerChunk = 1;
+
+	MappedFile file;
+	if (!file.open(path)){
 		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
-		getchar();
 		return false;
 	}
+	const char * end = file.end();
+
+	ObjSpillFile spill[3];
+	for (int k = 0; k < 3; ++k) spill[k].file = NULL;
+	ObjCounts total;
+	if (!openSpillFiles(path, scratchDirectory, spill) || !spillObjAttributes(path, file.begin(), end, spill, total)){
+		removeSpillFiles(spill);
+		return false;
+	}
+	MappedFile tables[3];
+	for (int k = 0; k < 3; ++k){
+		if (!tables[k].open(spill[k].path.c_str())){
+			printf("Could not map %s\n", spill[k].path.c_str());
+			removeSpillFiles(spill);
+			return false;
+		}
+	}
+	// The mappings keep the data alive on POSIX ; Windows refuses to delete mapped files
+#ifndef _WIN32
+	removeSpillFiles(spill);
+#endif
+	const glm::vec3 * positions = (const glm::vec3 *)tables[0].data();
+	const glm::vec2 * uvs = (const glm::vec2 *)tables[1].data();
+	const glm::vec3 * normals = (const glm::vec3 *)tables[2].data();
+
+	// Pass 2 : triangulate the faces into fixed-size chunks of de-indexed corners
+	std::vector<glm::vec3> chunkPositions(3 * trianglesPerChunk);
+	std::vector<glm::vec2> chunkUVs(total.uvs > 0 ? 3 * trianglesPerChunk : 0);
+	std::vector<glm::vec3> chunkNormals(total.normals > 0 ? 3 * trianglesPerChunk : 0);
+	ObjTriangleChunk chunk;
+	chunk.firstTriangle = 0;
+	chunk.triangleCount = 0;
+	chunk.positions = chunkPositions.data();
+	chunk.uvs = chunkUVs.empty() ? NULL : chunkUVs.data();
+	chunk.normals = chunkNormals.empty() ? NULL : chunkNormals.data();
 
-	while( 1 ){
-
-		char lineHeader[128];
-		// read the first word of the line
-		int res = fscanf(file, "%s", lineHeader);
-		if (res == EOF)
-			break; // EOF = End Of File. Quit the loop.
-
-		// else : parse lineHeader
-		
-		if ( strcmp( lineHeader, "v" ) == 0 ){
-			glm::vec3 vertex;
-			fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z );
-			temp_vertices.push_back(vertex);
-		}else if ( strcmp( lineHeader, "vn" ) == 0 ){
-			glm::vec3 normal;
-			fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z );
-			temp_normals.push_back(normal);
-		}else if ( strcmp( lineHeader, "f" ) == 0 ){
-			std::string vertex1, vertex2, vertex3;
-			unsigned int vertexIndex[3], normalIndex[3];
-			//int matches = fscanf(file, "%d/%*d/%d %d/%*d/%d %d/%*d/%d\n", &vertexIndex[0], &normalIndex[0], &vertexIndex[1], &normalIndex[1], &vertexIndex[2], &normalIndex[2] );
-			int matches = fscanf(file, "%d//%d %d//%d %d//%d\n", &vertexIndex[0], &normalIndex[0], &vertexIndex[1], &normalIndex[1], &vertexIndex[2], &normalIndex[2] );
-			if (matches != 6){
-				printf("File can't be read by our simple parser :-( Try exporting with other options\n");
-				fclose(file);
-				return false;
+	size_t line = 1;
+	ObjCounts before;
+	memset(&before, 0, sizeof(before));
+	std::vector<ObjCorner> polygon;
+	const char * error = NULL;
+	bool stopped = false;
+	forEachObjLine(file.begin(), end, [&](ObjLineType type, const char * p) -> const char * {
+		if (type == OBJ_POSITION) ++before.positions;
+		else if (type == OBJ_UV) ++before.uvs;
+		else if (type == OBJ_NORMAL) ++before.normals;
+		else if (type == OBJ_FACE){
+			polygon.clear();
+			while (!atLineEnd(p, end)){
+				long long index[3];
+				p = parseFaceCorner(skipBlankChars(p, end), end, index);
+				if (p == NULL || (p != end && !isSpaceChar(*p) && *p != '#')){
+					error = "File can't be read by our simple parser :-( Try exporting with other options";
+					return NULL;
+				}
+				ObjCorner corner;
+				if (!resolveObjIndex(index[0], before.positions, total.positions, corner.position) ||
+					!resolveObjIndex(index[1], before.uvs, total.uvs, corner.uv) ||
+					!resolveObjIndex(index[2], before.normals, total.normals, corner.normal)){
+					error = "face index out of range";
+					return NULL;
+				}
+				polygon.push_back(corner);
+			}
+			if (polygon.size() < 3){
+				error = "face with less than 3 vertices";
+				return NULL;
+			}
+			for (size_t k = 1; k + 1 < polygon.size(); ++k){
+				const ObjCorner * triangle[3] = { &polygon[0], &polygon[k], &polygon[k + 1] };
+				for (int c = 0; c < 3; ++c){
+					const size_t i = 3 * chunk.triangleCount + c;
+					chunkPositions[i] = positions[triangle[c]->position];
+					if (chunk.uvs != NULL)
+						chunkUVs[i] = (triangle[c]->uv != OBJ_NO_INDEX) ? uvs[triangle[c]->uv] : glm::vec2(0.0f);
+					if (chunk.normals != NULL)
+						chunkNormals[i] = (triangle[c]->normal != OBJ_NO_INDEX) ? normals[triangle[c]->normal] : glm::vec3(0.0f);
+				}
+				if (++chunk.triangleCount == trianglesPerChunk){
+					if (!onChunk(chunk)){
+						stopped = true;
+						return NULL;
+					}
+					chunk.firstTriangle += chunk.triangleCount;
+					chunk.triangleCount = 0;
+				}
 			}
-			vertexIndices.push_back(vertexIndex[0]);
-			vertexIndices.push_back(vertexIndex[1]);
-			vertexIndices.push_back(vertexIndex[2]);
-			normalIndices.push_back(normalIndex[0]);
-			normalIndices.push_back(normalIndex[1]);
-			normalIndices.push_back(normalIndex[2]);
-		}else{
-			// Probably a comment, eat up the rest of the line
-			char stupidBuffer[1000];
-			fgets(stupidBuffer, 1000, file);
 		}
+		++line;
+		return p;
+	});
+	if (error == NULL && !stopped && chunk.triangleCount > 0)
+		stopped = !onChunk(chunk);
 
+	for (int k = 0; k < 3; ++k)
+		tables[k].close();
+#ifdef _WIN32
+	removeSpillFiles(spill);
+#endif
+	if (error != NULL){
+		printf("%s:%zu: %s\n", path, line, error);
+		return false;
 	}
+	return !stopped;
+}
 
-	// For each vertex of each triangle
-	for( unsigned int i=0; i<vertexIndices.size(); i++ ){
 
-		// Get the indices of its attributes
-		unsigned int vertexIndex = vertexIndices[i];
-		unsigned int normalIndex = normalIndices[i];
-		
-		// Get the attributes thanks to the index
-		glm::vec3 vertex = temp_vertices[ vertexIndex-1 ];
-		glm::vec3 normal = temp_normals[ normalIndex-1 ];
-		
-		// Put the attributes in buffers
-		out_vertices.push_back(vertex);
-		out_normals .push_back(normal);
-	
+// Binary sidecar layout (native endianness, every stream 16-byte aligned) :
+//   MeshCacheHeader
+//   MeshCacheStream x streamCount
+//   stream data
+// The sidecar is valid if version and source size match, and either the source modification time
+// or, failing that, the hash of the source contents (e.g. after a fresh checkout) match.
+namespace {
+
+const char MESH_CACHE_MAGIC[8] = { 'O', 'B', 'J', 'C', 'A', 'C', 'H', 'E' };
+const uint32_t MESH_CACHE_VERSION = 1;
+
+enum MeshCacheStreamType {
+	MESH_STREAM_POSITION = 0,   // glm::vec3 x vertexCount
+	MESH_STREAM_NORMAL = 1,     // glm::vec3 x vertexCount
+	MESH_STREAM_UV = 2,         // glm::vec2 x vertexCount
+	MESH_STREAM_INDEX = 3       // uint32_t x indexCount, absent for de-indexed meshes
+};
+
+struct MeshCacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t streamCount;
+	uint64_t sourceSize;
+	int64_t sourceModificationTime;
+	uint64_t sourceHash;
+	uint64_t vertexCount;
+	uint64_t indexCount;
+	uint64_t reserved;
+};
+
+struct MeshCacheStream {
+	uint32_t type;
+	uint32_t elementSize;
+	uint64_t offset;
+	uint64_t size;
+};
+
+static_assert(sizeof(MeshCacheHeader) == 64, "MeshCacheHeader must be tightly packed");
+static_assert(sizeof(MeshCacheStream) == 24, "MeshCacheStream must be tightly packed");
+
+std::string sidecarPath(const char * objPath){
+	return std::string(objPath) + ".cache";
+}
+
+uint64_t hashSourceFile(const char * path){
+	MappedFile source;
+	if (!source.open(path))
+		return 0;
+	return hashBytes(source.data(), source.size());
+}
+
+bool writeMeshCache(const char * cachePath, const FileInfo & source, uint64_t sourceHash,
+	const std::vector<glm::vec3> & vertices, const std::vector<glm::vec3> & normals){
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+	header.version = MESH_CACHE_VERSION;
+	header.streamCount = 2;
+	header.sourceSize = source.size;
+	header.sourceModificationTime = source.modificationTime;
+	header.sourceHash = sourceHash;
+	header.vertexCount = vertices.size();
+	header.indexCount = 0;
+
+	MeshCacheStream streams[2];
+	uint64_t offset = sizeof(header) + sizeof(streams);
+	offset = (offset + 15) & ~(uint64_t)15;
+	streams[0].type = MESH_STREAM_POSITION;
+	streams[0].elementSize = sizeof(glm::vec3);
+	streams[0].offset = offset;
+	streams[0].size = vertices.size() * sizeof(glm::vec3);
+	offset = (offset + streams[0].size + 15) & ~(uint64_t)15;
+	streams[1].type = MESH_STREAM_NORMAL;
+	streams[1].elementSize = sizeof(glm::vec3);
+	streams[1].offset = offset;
+	streams[1].size = normals.size() * sizeof(glm::vec3);
+
+	// Each stream starts 16-byte aligned, the gaps are zeros
+	static const char padding[16] = { 0 };
+	std::vector<FileChunk> chunks;
+	FileChunk headerChunk = { &header, sizeof(header) };
+	FileChunk streamsChunk = { streams, sizeof(streams) };
+	chunks.push_back(headerChunk);
+	chunks.push_back(streamsChunk);
+	uint64_t written = sizeof(header) + sizeof(streams);
+	for (int s = 0; s < 2; ++s){
+		FileChunk paddingChunk = { padding, (size_t)(streams[s].offset - written) };
+		FileChunk streamChunk = { (s == 0) ? (const void *)vertices.data() : (const void *)normals.data(), (size_t)streams[s].size };
+		chunks.push_back(paddingChunk);
+		chunks.push_back(streamChunk);
+		written = streams[s].offset + streams[s].size;
+	}
+	return writeFileReplacing(cachePath, chunks);
+}
+
+const MeshCacheStream * findStream(const MeshCacheHeader & header, const MeshCacheStream * streams, uint32_t type){
+	for (uint32_t s = 0; s < header.streamCount; ++s)
+		if (streams[s].type == type)
+			return &streams[s];
+	return NULL;
+}
+
+} // namespace
+
+MeshCache::MeshCache()
+	: count(0), positionData(NULL), normalData(NULL)
+{
+}
+
+bool MeshCache::mapSidecar(const char * cachePath, const FileInfo & source, const char * objPath){
+	if (!file.open(cachePath))
+		return false;
+	MeshCacheHeader header;
+	if (file.size() < sizeof(header))
+		return false;
+	memcpy(&header, file.data(), sizeof(header));
+	if (memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != MESH_CACHE_VERSION)
+		return false;
+	if (header.sourceSize != source.size)
+		return false;
+	if (header.sourceModificationTime != source.modificationTime){
+		if (header.sourceHash != hashSourceFile(objPath))
+			return false;
+		// Same contents, only touched : remember the new time so the next load skips the hash
+		header.sourceModificationTime = source.modificationTime;
+		FILE * update = fopen(cachePath, "r+b");
+		if (update != NULL){
+			fwrite(&header, sizeof(header), 1, update);
+			fclose(update);
+		}
+	}
+
+	const uint64_t tableEnd = sizeof(header) + (uint64_t)header.streamCount * sizeof(MeshCacheStream);
+	if (tableEnd > file.size())
+		return false;
+	const MeshCacheStream * streams = (const MeshCacheStream *)(file.data() + sizeof(header));
+	for (uint32_t s = 0; s < header.streamCount; ++s){
+		if (streams[s].offset % 16 != 0 || streams[s].offset > file.size() || streams[s].size > file.size() - streams[s].offset)
+			return false;
+	}
+	const MeshCacheStream * positions = findStream(header, streams, MESH_STREAM_POSITION);
+	const MeshCacheStream * normals = findStream(header, streams, MESH_STREAM_NORMAL);
+	// Bounded by the file size first, so the products below cannot wrap around
+	if (header.vertexCount > file.size() / sizeof(glm::vec3))
+		return false;
+	if (positions == NULL || normals == NULL ||
+		positions->size != header.vertexCount * sizeof(glm::vec3) || normals->size != header.vertexCount * sizeof(glm::vec3))
+		return false;
+
+	count = (size_t)header.vertexCount;
+	positionData = (const glm::vec3 *)(file.data() + positions->offset);
+	normalData = (const glm::vec3 *)(file.data() + normals->offset);
+	return true;
+}
+
+void MeshCache::release(){
+	file.close();
+	std::vector<glm::vec3>().swap(ownedVertices);
+	std::vector<glm::vec3>().swap(ownedNormals);
+	count = 0;
+	positionData = normalData = NULL;
+}
+
+bool MeshCache::load(const char * objPath){
+	release();
+
+	FileInfo source;
+	if (!getFileInfo(objPath, source)){
+		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
+		return false;
 	}
-	fclose(file);
+	const std::string cachePath = sidecarPath(objPath);
+	if (mapSidecar(cachePath.c_str(), source, objPath))
+		return true;
+	file.close();
+
+	// Missing or stale : parse the OBJ file and write a fresh sidecar
+	if (!parseOBJ(objPath, ownedVertices, ownedNormals))
+		return false;
+	if (writeMeshCache(cachePath.c_str(), source, hashSourceFile(objPath), ownedVertices, ownedNormals) &&
+		mapSidecar(cachePath.c_str(), source, objPath)){
+		std::vector<glm::vec3>().swap(ownedVertices);
+		std::vector<glm::vec3>().swap(ownedNormals);
+		return true;
+	}
+	printf("Could not write mesh cache %s, using the parsed data\n", cachePath.c_str());
+	file.close();
+	count = ownedVertices.size();
+	positionData = ownedVertices.data();
+	normalData = ownedNormals.data();
+	return true;
+}
+
+bool loadOBJ(
+	const char * path, 
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec3> & out_normals,
+	bool useCache
+){
+	if (!useCache)
+		return parseOBJ(path, out_vertices, out_normals);
+
+	MeshCache cache;
+	if (!cache.load(path))
+		return false;
+	out_vertices.insert(out_vertices.end(), cache.vertices(), cache.vertices() + cache.vertexCount());
+	out_normals.insert(out_normals.end(), cache.normals(), cache.normals() + cache.vertexCount());
 	return true;
 }
 
@@ -1,13 +1,87 @@
 #ifndef OBJLOADER_H
 #define OBJLOADER_H
 
+#include <vector>
+#include <functional>
+#include <glm/glm.hpp>
+
+#include "mappedfile.hpp"
+
+// Faces without normals get smooth ones, generated from the positions (edges sharper than 60 degrees
+// stay hard). With useCache, the parsed mesh is stored in a binary sidecar (path + ".cache") on the first
+// load and read back from it on later loads, as long as the OBJ file does not change.
 bool loadOBJ(
 	const char * path, 
 	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec3> & out_normals,
+	bool useCache = false
+);
+
+// Indexed OBJ loading : every distinct (v, vt, vn) combination of the faces becomes one vertex,
+// in order of first use, and out_indices holds 3 vertices per triangle.
+// Faces may use "v", "v/vt", "v//vn" or "v/vt/vn" corners and negative (relative) indices ;
+// polygons are fan-triangulated. out_uvs / out_normals are left empty if no face has uvs / normals.
+// The output vectors are replaced, not appended to.
+bool loadOBJIndexed(
+	const char * path,
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals
 );
 
+// One piece of a streamed OBJ mesh : triangleCount triangles of 3 de-indexed corners each.
+// uvs / normals are NULL if the file has none ; corners of faces that lack them get zeros.
+// The arrays are only valid during the callback.
+struct ObjTriangleChunk {
+	size_t firstTriangle;
+	size_t triangleCount;
+	const glm::vec3 * positions;
+	const glm::vec2 * uvs;
+	const glm::vec3 * normals;
+};
+
+// Reads OBJ files too big to load at once : the faces are triangulated like loadOBJIndexed does
+// and handed to onChunk trianglesPerChunk triangles at a time (fewer in the last chunk).
+// The attributes are first spilled to temporary binary files in scratchDirectory (NULL : TMPDIR, TEMP
+// or TMP, else the system default), which are memory-mapped while the faces are read. Apart from the page cache, which the system can
+// reclaim, memory use is the chunk arrays. onChunk returns false to stop ; streamOBJ then returns false.
+bool streamOBJ(
+	const char * path,
+	size_t trianglesPerChunk,
+	const std::function<bool(const ObjTriangleChunk &)> & onChunk,
+	const char * scratchDirectory = NULL
+);
+
+// De-indexed OBJ mesh backed by its binary sidecar.
+// The pointers point straight into the memory-mapped sidecar, ready for glBufferData ;
+// they stay valid until the MeshCache is destroyed or loaded again.
+class MeshCache {
+public:
+	MeshCache();
+
+	// Maps the sidecar of the given OBJ file, (re)building it first if it is missing or stale
+	bool load(const char * objPath);
+	// Unmaps the sidecar / frees the mesh
+	void release();
+
+	size_t vertexCount() const { return count; }
+	const glm::vec3 * vertices() const { return positionData; }
+	const glm::vec3 * normals() const { return normalData; }
+
+private:
+	MeshCache(const MeshCache &);
+	MeshCache & operator=(const MeshCache &);
+
+	bool mapSidecar(const char * cachePath, const FileInfo & source, const char * objPath);
 
+	MappedFile file;
+	// Used instead of the mapping when the sidecar cannot be written (read-only directory...)
+	std::vector<glm::vec3> ownedVertices, ownedNormals;
+	size_t count;
+	const glm::vec3 * positionData;
+	const glm::vec3 * normalData;
+};
 
 bool loadAssImp(
 	const char * path, 
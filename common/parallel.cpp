@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "parallel.hpp"
+
+static std::atomic<unsigned int> workerThreadOverride(0);
+
+unsigned int workerThreadCount(){
+	unsigned int count = workerThreadOverride.load();
+	if (count == 0)
+		count = std::thread::hardware_concurrency();
+	return count == 0 ? 1 : count;
+}
+
+void setWorkerThreadCount(unsigned int count){
+	workerThreadOverride = count;
+}
+
+namespace {
+
+// One runOnWorkerPool call, on the caller's stack
+struct PoolTask {
+	const std::function<void()> * work;
+	size_t unstarted;   // Copies no pool thread has taken yet
+	size_t running;     // Copies running on pool threads
+	std::condition_variable finished;
+};
+
+class WorkerPool {
+public:
+	WorkerPool() : stopping(false) {}
+
+	~WorkerPool(){
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		taskReady.notify_all();
+		for (size_t t = 0; t < threads.size(); ++t)
+			threads[t].join();
+	}
+
+	void run(size_t helperCount, const std::function<void()> & work){
+		PoolTask task;
+		task.work = &work;
+		task.unstarted = helperCount;
+		task.running = 0;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			// Grows with setWorkerThreadCount ; extra threads just stay idle when it shrinks
+			while (threads.size() < helperCount)
+				threads.push_back(std::thread(&WorkerPool::threadLoop, this));
+			tasks.push_back(&task);
+		}
+		if (helperCount == 1)
+			taskReady.notify_one();
+		else
+			taskReady.notify_all();
+
+		work();
+
+		std::unique_lock<std::mutex> lock(mutex);
+		// The copies nobody took are not needed any more : work() returned, so nothing is left
+		if (task.unstarted > 0){
+			tasks.erase(std::find(tasks.begin(), tasks.end(), &task));
+			task.unstarted = 0;
+		}
+		while (task.running > 0)
+			task.finished.wait(lock);
+	}
+
+private:
+	void threadLoop(){
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;){
+			while (!stopping && tasks.empty())
+				taskReady.wait(lock);
+			if (stopping)
+				return;
+			PoolTask * task = tasks.front();
+			if (--task->unstarted == 0)
+				tasks.pop_front();
+			++task->running;
+			lock.unlock();
+			(*task->work)();
+			lock.lock();
+			if (--task->running == 0)
+				task->finished.notify_one();
+		}
+	}
+
+	std::mutex mutex;
+	std::condition_variable taskReady;
+	std::deque<PoolTask *> tasks;
+	std::vector<std::thread> threads;
+	bool stopping;
+};
+
+} // namespace
+
+void runOnWorkerPool(size_t helperCount, const std::function<void()> & work){
+	static WorkerPool pool;
+	if (helperCount == 0){
+		work();
+		return;
+	}
+	pool.run(helperCount, work);
+}
@@ -0,0 +1,59 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <cstddef>
+#include <atomic>
+#include <functional>
+
+// Number of threads the parallel helpers may use (hardware concurrency by default, at least 1)
+unsigned int workerThreadCount();
+// Overrides workerThreadCount(). 0 restores the default.
+void setWorkerThreadCount(unsigned int count);
+
+// Runs work on the calling thread and on up to helperCount threads of a pool shared by every
+// caller (created on first use, workerThreadCount() - 1 threads), and returns once every started
+// copy has returned. Pool threads busy with other calls are not waited for : work must be able to
+// finish everything alone, as the loop of parallelFor does.
+void runOnWorkerPool(size_t helperCount, const std::function<void()> & work);
+
+// Calls f(i) for every i in [0, count), spread over up to workerThreadCount() threads.
+// The calling thread takes part, and items are handed out dynamically so uneven items balance out.
+// Returns once every call has finished. f must not throw. Never creates threads : nested calls
+// (inside f, or from the workers of AssetLoader / TextureLoader) share the same pool, and the
+// caller does the items no pool thread is free to take.
+template <typename F>
+void parallelFor(size_t count, F f){
+	size_t threadCount = workerThreadCount();
+	if (threadCount > count) threadCount = count;
+	if (threadCount <= 1){
+		for (size_t i = 0; i < count; ++i)
+			f(i);
+		return;
+	}
+
+	std::atomic<size_t> next(0);
+	runOnWorkerPool(threadCount - 1, [&](){
+		for (size_t i = next++; i < count; i = next++)
+			f(i);
+	});
+}
+
+// Splits [0, count) into contiguous blocks of at least minBlock items and calls f(begin, end) for each.
+// Blocks depend on count, minBlock and the worker thread count, never on timing : per-block results merge
+// deterministically from run to run, but the boundaries (and float sums) may differ between machines.
+inline size_t parallelBlockCount(size_t count, size_t minBlock){
+	size_t blocks = (size_t)workerThreadCount() * 4;
+	if (minBlock == 0) minBlock = 1;
+	if (blocks > (count + minBlock - 1) / minBlock) blocks = (count + minBlock - 1) / minBlock;
+	return blocks == 0 ? 1 : blocks;
+}
+
+template <typename F>
+void parallelForBlocks(size_t count, size_t minBlock, F f){
+	const size_t blocks = parallelBlockCount(count, minBlock);
+	parallelFor(blocks, [&](size_t b){
+		f(count * b / blocks, count * (b + 1) / blocks);
+	});
+}
+
+#endif
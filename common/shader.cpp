@@ -1,101 +1,104 @@
 #include "shader.hpp"
+#include "mappedfile.hpp"
 
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
-
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if(VertexShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(VertexShaderStream, Line))
-			VertexShaderCode += "\n" + Line;
-		VertexShaderStream.close();
-	}else{
-		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
-		getchar();
-		return 0;
-	}
-
-	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if(FragmentShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(FragmentShaderStream, Line))
-			FragmentShaderCode += "\n" + Line;
-		FragmentShaderStream.close();
-	}
-
-	GLint Result = GL_FALSE;
-	int InfoLogLength;
-
-
-	// Compile Vertex Shader
-	printf("Compiling shader : %s\n", vertex_file_path);
-	char const * VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
-	glCompileShader(VertexShaderID);
-
-	// Check Vertex Shader
-	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if ( InfoLogLength > 0 ){
-		std::vector<char> VertexShaderErrorMessage(InfoLogLength+1);
-		glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-		printf("%s\n", &VertexShaderErrorMessage[0]);
-	}
+// Program binaries are stored as a ProgramCacheHeader followed by the binary
+static const char PROGRAM_CACHE_MAGIC[8] = { 'P', 'R', 'O', 'G', 'B', 'I', 'N', '1' };
 
+struct ProgramCacheHeader {
+	char magic[8];
+	uint64_t key;
+	uint32_t format;
+	uint32_t size;
+};
 
+static std::string ProgramCacheDirectory;
 
-	// Compile Fragment Shader
-	printf("Compiling shader : %s\n", fragment_file_path);
-	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
-	glCompileShader(FragmentShaderID);
-
-	// Check Fragment Shader
-	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if ( InfoLogLength > 0 ){
-		std::vector<char> FragmentShaderErrorMessage(InfoLogLength+1);
-		glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-		printf("%s\n", &FragmentShaderErrorMessage[0]);
-	}
-
+void setProgramCacheDirectory(const char * directory){
+	ProgramCacheDirectory = directory != NULL ? directory : "";
+}
 
+// Reads the whole file at once
+static bool readShaderFile(const char * path, std::string & code){
+	MappedFile file;
+	if (!file.open(path))
+		return false;
+	code.assign(file.begin(), file.end());
+	return true;
+}
 
-	// Link the program
-	printf("Linking program\n");
-	GLuint ProgramID = glCreateProgram();
-	glAttachShader(ProgramID, VertexShaderID);
-	glAttachShader(ProgramID, FragmentShaderID);
-	glLinkProgram(ProgramID);
+bool programCacheEnabled(){
+	if (ProgramCacheDirectory.empty())
+		return false;
+	if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+		return false;
+	GLint formatCount = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+	return formatCount > 0;
+}
 
-	// Check the program
-	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if ( InfoLogLength > 0 ){
-		std::vector<char> ProgramErrorMessage(InfoLogLength+1);
-		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-		printf("%s\n", &ProgramErrorMessage[0]);
+// Binaries only work with the driver that made them : its identity is part of the key
+uint64_t programCacheKey(const std::string & VertexShaderCode, const std::string & FragmentShaderCode){
+	uint64_t key = hashBytes(VertexShaderCode.data(), VertexShaderCode.size(), VertexShaderCode.size());
+	key = hashBytes(FragmentShaderCode.data(), FragmentShaderCode.size(), key);
+	const GLenum identity[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+	for (size_t i = 0; i < sizeof(identity) / sizeof(identity[0]); ++i){
+		const char * value = (const char *)glGetString(identity[i]);
+		if (value != NULL)
+			key = hashBytes(value, strlen(value), key);
 	}
+	return key;
+}
 
-	
-	glDetachShader(ProgramID, VertexShaderID);
-	glDetachShader(ProgramID, FragmentShaderID);
-	
-	glDeleteShader(VertexShaderID);
-	glDeleteShader(FragmentShaderID);
+static std::string programCachePath(uint64_t key){
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.program", (unsigned long long)key);
+	return ProgramCacheDirectory + "/" + name;
+}
 
-	return ProgramID;
+bool loadProgramBinary(uint64_t key, GLuint ProgramID){
+	MappedFile file;
+	if (!file.open(programCachePath(key).c_str()))
+		return false;
+	ProgramCacheHeader header;
+	if (file.size() < sizeof(header))
+		return false;
+	memcpy(&header, file.data(), sizeof(header));
+	if (memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.key != key ||
+		file.size() - sizeof(header) < header.size)
+		return false;
+	glProgramBinary(ProgramID, header.format, file.data() + sizeof(header), header.size);
+	return true;
 }
 
+void saveProgramBinary(uint64_t key, GLuint ProgramID){
+	GLint size = 0;
+	glGetProgramiv(ProgramID, GL_PROGRAM_BINARY_LENGTH, &size);
+	if (size <= 0)
+		return;
+	std::vector<char> binary(size);
+	GLenum format = 0;
+	glGetProgramBinary(ProgramID, size, &size, &format, &binary[0]);
+
+	ProgramCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+	header.key = key;
+	header.format = format;
+	header.size = (uint32_t)size;
+
+	std::string path = programCachePath(key);
+	std::vector<FileChunk> chunks;
+	FileChunk headerChunk = { &header, sizeof(header) };
+	FileChunk binaryChunk = { &binary[0], (size_t)size };
+	chunks.push_back(headerChunk);
+	chunks.push_back(binaryChunk);
+	if (!writeFileReplacing(path.c_str(), chunks))
+		printf("Could not write %s\n", path.c_str());
+}
 
-GLuint LoadShadersSource(std::string VertexShaderCode, std::string FragmentShaderCode){
+// Compiles and links ; the paths only name the shaders in the messages (NULL : no message)
+static GLuint compileProgram(const std::string & VertexShaderCode, const std::string & FragmentShaderCode,
+	const char * vertex_file_path, const char * fragment_file_path, bool retrievable){
 
 	// Create the shaders
 	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
@@ -106,6 +109,7 @@ GLuint LoadShadersSource(std::string VertexShaderCode, std::string FragmentShade
 
 
 	// Compile Vertex Shader
+	if (vertex_file_path != NULL) printf("Compiling shader : %s\n", vertex_file_path);
 	char const * VertexSourcePointer = VertexShaderCode.c_str();
 	glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
 	glCompileShader(VertexShaderID);
@@ -122,6 +126,7 @@ GLuint LoadShadersSource(std::string VertexShaderCode, std::string FragmentShade
 
 
 	// Compile Fragment Shader
+	if (fragment_file_path != NULL) printf("Compiling shader : %s\n", fragment_file_path);
 	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
 	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
 	glCompileShader(FragmentShaderID);
@@ -135,11 +140,15 @@ GLuint LoadShadersSource(std::string VertexShaderCode, std::string FragmentShade
 		printf("%s\n", &FragmentShaderErrorMessage[0]);
 	}
 
+
+
 	// Link the program
 	printf("Linking program\n");
 	GLuint ProgramID = glCreateProgram();
 	glAttachShader(ProgramID, VertexShaderID);
 	glAttachShader(ProgramID, FragmentShaderID);
+	if (retrievable)
+		glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(ProgramID);
 
 	// Check the program
@@ -161,3 +170,50 @@ GLuint LoadShadersSource(std::string VertexShaderCode, std::string FragmentShade
 	return ProgramID;
 }
 
+// The cached binary when there is one, otherwise a compile whose binary goes to the cache
+static GLuint loadProgram(const std::string & VertexShaderCode, const std::string & FragmentShaderCode,
+	const char * vertex_file_path, const char * fragment_file_path){
+	const bool cached = programCacheEnabled();
+	uint64_t key = 0;
+	if (cached){
+		key = programCacheKey(VertexShaderCode, FragmentShaderCode);
+		GLuint ProgramID = glCreateProgram();
+		// Drivers reject the binaries of their previous versions, whatever the key says
+		GLint Result = GL_FALSE;
+		if (loadProgramBinary(key, ProgramID))
+			glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+		if (Result == GL_TRUE)
+			return ProgramID;
+		glDeleteProgram(ProgramID);
+	}
+
+	GLuint ProgramID = compileProgram(VertexShaderCode, FragmentShaderCode, vertex_file_path, fragment_file_path, cached);
+	GLint Result = GL_FALSE;
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	if (cached && Result == GL_TRUE)
+		saveProgramBinary(key, ProgramID);
+	return ProgramID;
+}
+
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
+
+	// Read the Vertex Shader code from the file
+	std::string VertexShaderCode;
+	if (!readShaderFile(vertex_file_path, VertexShaderCode)){
+		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
+		getchar();
+		return 0;
+	}
+
+	// Read the Fragment Shader code from the file
+	std::string FragmentShaderCode;
+	if (!readShaderFile(fragment_file_path, FragmentShaderCode))
+		printf("Impossible to open %s\n", fragment_file_path);
+
+	return loadProgram(VertexShaderCode, FragmentShaderCode, vertex_file_path, fragment_file_path);
+}
+
+
+GLuint LoadShadersSource(std::string VertexShaderCode, std::string FragmentShaderCode){
+	return loadProgram(VertexShaderCode, FragmentShaderCode, NULL, NULL);
+}
@@ -8,6 +8,7 @@
 #include <algorithm>
 using namespace std;
 
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 
@@ -17,4 +18,20 @@ using namespace std;
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path);
 GLuint LoadShadersSource(std::string VertexShaderCode, std::string FragmentShaderCode);
 
+// Once set, the two functions above keep the linked programs in directory (glGetProgramBinary),
+// keyed by a hash of both sources and of the driver identity, and load them back with
+// glProgramBinary instead of compiling ; a binary the driver rejects is compiled again. Needs
+// GL 4.1 or ARB_get_program_binary, otherwise programs are always compiled. NULL or "" turns
+// the cache off (the default).
+void setProgramCacheDirectory(const char * directory);
+
+// The cache itself, for other loaders (see ShaderCompiler). Enabled once a directory is set
+// and the driver supports binaries. loadProgramBinary() gives the cached binary of key to
+// glProgramBinary and returns false if there is none ; GL_LINK_STATUS then tells whether the
+// driver took it. saveProgramBinary() needs a program linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT.
+bool programCacheEnabled();
+uint64_t programCacheKey(const std::string & VertexShaderCode, const std::string & FragmentShaderCode);
+bool loadProgramBinary(uint64_t key, GLuint ProgramID);
+void saveProgramBinary(uint64_t key, GLuint ProgramID);
+
 #endif
@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <GL/glew.h>
+
+#include <glfw3.h>
+
+#include "mappedfile.hpp"
+#include "shader.hpp"
+#include "shadercompiler.hpp"
+
+// Our GLEW knows GL_ARB_parallel_shader_compile but not the KHR version, which has the same
+// enum and entry point
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (GLAPIENTRY * MaxShaderCompilerThreadsProc)(GLuint count);
+
+namespace {
+
+bool hasExtension(const char * name){
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; ++i){
+		const char * extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+		if (extension != NULL && strcmp(extension, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+void printShaderLog(GLuint shader, const std::string & name){
+	GLint length = 0;
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+	if (length > 1){
+		std::vector<char> message(length + 1);
+		glGetShaderInfoLog(shader, length, NULL, &message[0]);
+		printf("%s : %s\n", name.c_str(), &message[0]);
+	}
+}
+
+void printProgramLog(GLuint program, const std::string & name){
+	GLint length = 0;
+	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+	if (length > 1){
+		std::vector<char> message(length + 1);
+		glGetProgramInfoLog(program, length, NULL, &message[0]);
+		printf("%s : %s\n", name.c_str(), &message[0]);
+	}
+}
+
+} // namespace
+
+ShaderCompiler::ShaderCompiler() : pendingCount(0), parallel(false) {
+	// 0xFFFFFFFF : as many compiler threads as the driver likes
+	if (GLEW_ARB_parallel_shader_compile){
+		parallel = true;
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+	}else if (hasExtension("GL_KHR_parallel_shader_compile")){
+		parallel = true;
+		MaxShaderCompilerThreadsProc maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+		if (maxShaderCompilerThreads != NULL)
+			maxShaderCompilerThreads(0xFFFFFFFF);
+	}
+}
+
+ShaderCompiler::~ShaderCompiler(){
+	for (size_t i = 0; i < programs.size(); ++i){
+		PendingProgram & pending = programs[i];
+		if (pending.state == PROGRAM_READY || pending.state == PROGRAM_FAILED)
+			continue;
+		if (pending.vertexShader != 0) glDeleteShader(pending.vertexShader);
+		if (pending.fragmentShader != 0) glDeleteShader(pending.fragmentShader);
+		if (pending.program != 0) glDeleteProgram(pending.program);
+	}
+}
+
+size_t ShaderCompiler::submit(const std::string & vertexCode, const std::string & fragmentCode, GLuint fallback){
+	programs.push_back(PendingProgram());
+	PendingProgram & pending = programs.back();
+	char name[32];
+	snprintf(name, sizeof(name), "Program %u", (unsigned int)programs.size() - 1);
+	pending.name = name;
+	pending.vertexCode = vertexCode;
+	pending.fragmentCode = fragmentCode;
+	pending.vertexShader = pending.fragmentShader = pending.program = 0;
+	pending.fallback = fallback;
+	pending.cacheKey = 0;
+	pending.fromBinary = false;
+	++pendingCount;
+
+	if (programCacheEnabled()){
+		pending.cacheKey = programCacheKey(vertexCode, fragmentCode);
+		pending.program = glCreateProgram();
+		if (loadProgramBinary(pending.cacheKey, pending.program)){
+			// glProgramBinary links too : the program is checked like a linked one
+			pending.fromBinary = true;
+			pending.state = PROGRAM_LINKING;
+			return programs.size() - 1;
+		}
+		glDeleteProgram(pending.program);
+		pending.program = 0;
+	}
+	startCompile(pending);
+	return programs.size() - 1;
+}
+
+size_t ShaderCompiler::submitFiles(const char * vertexPath, const char * fragmentPath, GLuint fallback){
+	MappedFile vertexFile, fragmentFile;
+	const bool opened = vertexFile.open(vertexPath) && fragmentFile.open(fragmentPath);
+	if (!opened){
+		printf("Impossible to open %s or %s. Are you in the right directory ?\n", vertexPath, fragmentPath);
+		programs.push_back(PendingProgram());
+		PendingProgram & pending = programs.back();
+		pending.vertexShader = pending.fragmentShader = pending.program = 0;
+		pending.fallback = fallback;
+		pending.cacheKey = 0;
+		pending.fromBinary = false;
+		pending.state = PROGRAM_FAILED;
+		return programs.size() - 1;
+	}
+	size_t handle = submit(std::string(vertexFile.begin(), vertexFile.end()),
+		std::string(fragmentFile.begin(), fragmentFile.end()), fallback);
+	programs[handle].name = std::string(vertexPath) + " + " + fragmentPath;
+	return handle;
+}
+
+void ShaderCompiler::startCompile(PendingProgram & pending){
+	const char * vertexSource = pending.vertexCode.c_str();
+	const char * fragmentSource = pending.fragmentCode.c_str();
+	pending.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(pending.vertexShader, 1, &vertexSource, NULL);
+	glCompileShader(pending.vertexShader);
+	pending.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(pending.fragmentShader, 1, &fragmentSource, NULL);
+	glCompileShader(pending.fragmentShader);
+	pending.fromBinary = false;
+	pending.state = PROGRAM_COMPILING;
+}
+
+bool ShaderCompiler::isComplete(GLuint object, bool isProgram) const {
+	if (!parallel)
+		return true;   // The status queries below are what waits then
+	GLint complete = GL_FALSE;
+	if (isProgram)
+		glGetProgramiv(object, GL_COMPLETION_STATUS_KHR, &complete);
+	else
+		glGetShaderiv(object, GL_COMPLETION_STATUS_KHR, &complete);
+	return complete == GL_TRUE;
+}
+
+bool ShaderCompiler::finishCompile(PendingProgram & pending, bool block){
+	if (!block && (!isComplete(pending.vertexShader, false) || !isComplete(pending.fragmentShader, false)))
+		return false;
+	GLint vertexResult = GL_FALSE, fragmentResult = GL_FALSE;
+	glGetShaderiv(pending.vertexShader, GL_COMPILE_STATUS, &vertexResult);
+	glGetShaderiv(pending.fragmentShader, GL_COMPILE_STATUS, &fragmentResult);
+	printShaderLog(pending.vertexShader, pending.name);
+	printShaderLog(pending.fragmentShader, pending.name);
+	if (vertexResult != GL_TRUE || fragmentResult != GL_TRUE){
+		glDeleteShader(pending.vertexShader);
+		glDeleteShader(pending.fragmentShader);
+		pending.vertexShader = pending.fragmentShader = 0;
+		pending.state = PROGRAM_FAILED;
+		return true;
+	}
+	pending.program = glCreateProgram();
+	glAttachShader(pending.program, pending.vertexShader);
+	glAttachShader(pending.program, pending.fragmentShader);
+	if (pending.cacheKey != 0)
+		glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(pending.program);
+	pending.state = PROGRAM_LINKING;
+	return true;
+}
+
+bool ShaderCompiler::finishLink(PendingProgram & pending, bool block){
+	if (!block && !isComplete(pending.program, true))
+		return false;
+	GLint result = GL_FALSE;
+	glGetProgramiv(pending.program, GL_LINK_STATUS, &result);
+	if (pending.fromBinary && result != GL_TRUE){
+		// The driver did not take the cached binary (it was updated...) : compile after all
+		glDeleteProgram(pending.program);
+		pending.program = 0;
+		startCompile(pending);
+		return true;
+	}
+	if (!pending.fromBinary){
+		printProgramLog(pending.program, pending.name);
+		glDetachShader(pending.program, pending.vertexShader);
+		glDetachShader(pending.program, pending.fragmentShader);
+		glDeleteShader(pending.vertexShader);
+		glDeleteShader(pending.fragmentShader);
+		pending.vertexShader = pending.fragmentShader = 0;
+	}
+	if (result != GL_TRUE){
+		glDeleteProgram(pending.program);
+		pending.program = 0;
+		pending.state = PROGRAM_FAILED;
+		return true;
+	}
+	if (!pending.fromBinary && pending.cacheKey != 0)
+		saveProgramBinary(pending.cacheKey, pending.program);
+	pending.state = PROGRAM_READY;
+	std::string().swap(pending.vertexCode);
+	std::string().swap(pending.fragmentCode);
+	return true;
+}
+
+size_t ShaderCompiler::poll(){
+	size_t finished = 0;
+	for (size_t i = 0; i < programs.size(); ++i){
+		PendingProgram & pending = programs[i];
+		if (pending.state == PROGRAM_READY || pending.state == PROGRAM_FAILED)
+			continue;
+		// Without the extension, everything below blocks : one program per call
+		const bool block = !parallel;
+		for (;;){
+			bool progressed = pending.state == PROGRAM_COMPILING ? finishCompile(pending, block) : finishLink(pending, block);
+			if (!progressed || pending.state == PROGRAM_READY || pending.state == PROGRAM_FAILED)
+				break;
+		}
+		if (pending.state == PROGRAM_READY || pending.state == PROGRAM_FAILED){
+			++finished;
+			--pendingCount;
+			if (!parallel)
+				break;
+		}
+	}
+	return finished;
+}
+
+void ShaderCompiler::wait(size_t handle){
+	PendingProgram & pending = programs[handle];
+	if (pending.state == PROGRAM_READY || pending.state == PROGRAM_FAILED)
+		return;
+	while (pending.state != PROGRAM_READY && pending.state != PROGRAM_FAILED){
+		if (pending.state == PROGRAM_COMPILING)
+			finishCompile(pending, true);
+		else
+			finishLink(pending, true);
+	}
+	--pendingCount;
+}
+
+bool ShaderCompiler::isReady(size_t handle) const {
+	return programs[handle].state == PROGRAM_READY;
+}
+
+bool ShaderCompiler::hasFailed(size_t handle) const {
+	return programs[handle].state == PROGRAM_FAILED;
+}
+
+bool ShaderCompiler::isIdle() const {
+	return pendingCount == 0;
+}
+
+GLuint ShaderCompiler::program(size_t handle) const {
+	const PendingProgram & pending = programs[handle];
+	return pending.state == PROGRAM_READY ? pending.program : pending.fallback;
+}
@@ -0,0 +1,70 @@
+#ifndef SHADERCOMPILER_HPP
+#define SHADERCOMPILER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Compiles many programs at once without blocking the render thread. submit() only starts the
+// compiles ; poll() moves every program forward as far as it can without waiting, and a
+// program keeps answering with its fallback until it is ready, so the render loop can start
+// right away and switch over as programs come in.
+// With GL_KHR_parallel_shader_compile (or the ARB version) the driver compiles on its own
+// threads and GL_COMPLETION_STATUS_KHR says when a shader or program is done. Without it,
+// poll() finishes one program per call, which still spreads the stalls over several frames.
+// Uses the program binary cache of shader.hpp when it is enabled.
+class ShaderCompiler {
+public:
+	ShaderCompiler();
+	// Deletes the programs that are not ready yet ; the ready ones belong to the caller
+	~ShaderCompiler();
+
+	// Returns a handle ; fallback (may be 0) is what program() gives until the program is ready
+	size_t submit(const std::string & vertexCode, const std::string & fragmentCode, GLuint fallback = 0);
+	// Same with the sources read from files ; a missing file makes the program fail
+	size_t submitFiles(const char * vertexPath, const char * fragmentPath, GLuint fallback = 0);
+
+	// Never waits. Returns the number of programs that became ready or failed.
+	size_t poll();
+	// Waits until handle is ready or failed, like LoadShaders would
+	void wait(size_t handle);
+
+	bool isReady(size_t handle) const;
+	bool hasFailed(size_t handle) const;
+	// True when every program is ready or failed
+	bool isIdle() const;
+	// The linked program once ready, the fallback before that or after a failure
+	GLuint program(size_t handle) const;
+
+	// Whether the driver compiles in parallel
+	bool isParallel() const { return parallel; }
+
+private:
+	ShaderCompiler(const ShaderCompiler &);
+	ShaderCompiler & operator=(const ShaderCompiler &);
+
+	enum ProgramState { PROGRAM_COMPILING, PROGRAM_LINKING, PROGRAM_READY, PROGRAM_FAILED };
+
+	struct PendingProgram {
+		std::string name;            // For the messages
+		std::string vertexCode, fragmentCode;
+		GLuint vertexShader, fragmentShader, program, fallback;
+		uint64_t cacheKey;
+		bool fromBinary;             // program came from the cache : no shaders to check
+		ProgramState state;
+	};
+
+	void startCompile(PendingProgram & pending);
+	// Each step returns false when the driver is not done yet (only when parallel)
+	bool finishCompile(PendingProgram & pending, bool block);
+	bool finishLink(PendingProgram & pending, bool block);
+	bool isComplete(GLuint object, bool isProgram) const;
+
+	std::vector<PendingProgram> programs;
+	size_t pendingCount;
+	bool parallel;
+};
+
+#endif
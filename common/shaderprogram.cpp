@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <GL/glew.h>
+
+#include "shader.hpp"
+#include "shaderprogram.hpp"
+
+namespace {
+
+// Bytes of the shadow copy of a uniform of this type (one element of arrays)
+size_t shadowBytes(GLenum type){
+	switch (type){
+	case GL_FLOAT_VEC2: case GL_INT_VEC2: case GL_BOOL_VEC2: return 8;
+	case GL_FLOAT_VEC3: case GL_INT_VEC3: case GL_BOOL_VEC3: return 12;
+	case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_BOOL_VEC4: case GL_FLOAT_MAT2: return 16;
+	case GL_FLOAT_MAT3: return 36;
+	case GL_FLOAT_MAT4: return 64;
+	case GL_FLOAT_MAT2x3: case GL_FLOAT_MAT3x2: return 24;
+	case GL_FLOAT_MAT2x4: case GL_FLOAT_MAT4x2: return 32;
+	case GL_FLOAT_MAT3x4: case GL_FLOAT_MAT4x3: return 48;
+	default: return 4;   // Scalars and samplers
+	}
+}
+
+// "lights[0]" -> "lights" : arrays are reported by their first element
+std::string baseName(const char * name){
+	size_t length = strlen(name);
+	if (length > 3 && strcmp(name + length - 3, "[0]") == 0)
+		length -= 3;
+	return std::string(name, length);
+}
+
+} // namespace
+
+GLuint ShaderProgram::boundProgram = 0;
+
+bool ShaderProgram::load(const char * vertexPath, const char * fragmentPath){
+	GLuint program = LoadShaders(vertexPath, fragmentPath);
+	GLint linked = GL_FALSE;
+	if (program != 0)
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked != GL_TRUE){
+		if (program != 0) glDeleteProgram(program);
+		reset(0);
+		return false;
+	}
+	reset(program);
+	return true;
+}
+
+void ShaderProgram::reset(GLuint program){
+	programID = program;
+	directState = GLEW_VERSION_4_1 || GLEW_ARB_separate_shader_objects;
+	uniformInfos.clear();
+	attributeInfos.clear();
+	blockInfos.clear();
+	shadows.clear();
+	if (program == 0)
+		return;
+
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::vector<char> name(maxLength + 1);
+	for (GLint i = 0; i < count; ++i){
+		UniformInfo info;
+		glGetActiveUniform(program, i, (GLsizei)name.size(), NULL, &info.size, &info.type, &name[0]);
+		info.location = glGetUniformLocation(program, &name[0]);
+		if (info.location < 0)
+			continue;   // Member of a uniform block : set through the buffer
+		info.name = baseName(&name[0]);
+		info.shadowOffset = shadows.size();
+		info.shadowValid = false;
+		shadows.resize(shadows.size() + shadowBytes(info.type));
+		uniformInfos.push_back(info);
+	}
+
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+	name.assign(maxLength + 1, 0);
+	for (GLint i = 0; i < count; ++i){
+		AttributeInfo info;
+		glGetActiveAttrib(program, i, (GLsizei)name.size(), NULL, &info.size, &info.type, &name[0]);
+		info.location = glGetAttribLocation(program, &name[0]);
+		info.name = baseName(&name[0]);
+		attributeInfos.push_back(info);
+	}
+
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+	name.assign(maxLength + 1, 0);
+	for (GLint i = 0; i < count; ++i){
+		UniformBlockInfo info;
+		GLint binding = 0;
+		glGetActiveUniformBlockName(program, i, (GLsizei)name.size(), NULL, &name[0]);
+		glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_DATA_SIZE, &info.dataSize);
+		glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_BINDING, &binding);
+		info.name = &name[0];
+		info.index = (GLuint)i;
+		info.binding = (GLuint)binding;
+		blockInfos.push_back(info);
+	}
+}
+
+void ShaderProgram::invalidateShadows(){
+	for (size_t i = 0; i < uniformInfos.size(); ++i)
+		uniformInfos[i].shadowValid = false;
+}
+
+size_t ShaderProgram::findUniform(const char * name) const {
+	for (size_t i = 0; i < uniformInfos.size(); ++i)
+		if (uniformInfos[i].name == name)
+			return i;
+	return NOT_FOUND;
+}
+
+GLint ShaderProgram::attribute(const char * name) const {
+	for (size_t i = 0; i < attributeInfos.size(); ++i)
+		if (attributeInfos[i].name == name)
+			return attributeInfos[i].location;
+	return -1;
+}
+
+size_t ShaderProgram::uniformBlock(const char * name) const {
+	for (size_t i = 0; i < blockInfos.size(); ++i)
+		if (blockInfos[i].name == name)
+			return i;
+	return NOT_FOUND;
+}
+
+void ShaderProgram::bindUniformBlock(size_t block, GLuint binding){
+	if (block >= blockInfos.size() || blockInfos[block].binding == binding)
+		return;
+	glUniformBlockBinding(programID, blockInfos[block].index, binding);
+	blockInfos[block].binding = binding;
+}
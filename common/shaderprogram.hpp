@@ -0,0 +1,170 @@
+#ifndef SHADERPROGRAM_HPP
+#define SHADERPROGRAM_HPP
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// What GLSL types a C++ type can be uploaded to, and how : upload() writes to the program in use,
+// uploadTo() to the given program (GL 4.1 or ARB_separate_shader_objects)
+template <typename T> struct UniformTraits;
+
+template <> struct UniformTraits<float> {
+	static bool accepts(GLenum type) { return type == GL_FLOAT; }
+	static void upload(GLint location, const float & value) { glUniform1fv(location, 1, &value); }
+	static void uploadTo(GLuint program, GLint location, const float & value) { glProgramUniform1fv(program, location, 1, &value); }
+};
+template <> struct UniformTraits<int> {
+	// Samplers are set through their texture unit
+	static bool accepts(GLenum type) {
+		return type == GL_INT || type == GL_BOOL || type == GL_SAMPLER_2D || type == GL_SAMPLER_3D ||
+			type == GL_SAMPLER_CUBE || type == GL_SAMPLER_2D_ARRAY || type == GL_SAMPLER_2D_SHADOW;
+	}
+	static void upload(GLint location, const int & value) { glUniform1iv(location, 1, &value); }
+	static void uploadTo(GLuint program, GLint location, const int & value) { glProgramUniform1iv(program, location, 1, &value); }
+};
+template <> struct UniformTraits<glm::vec2> {
+	static bool accepts(GLenum type) { return type == GL_FLOAT_VEC2; }
+	static void upload(GLint location, const glm::vec2 & value) { glUniform2fv(location, 1, &value[0]); }
+	static void uploadTo(GLuint program, GLint location, const glm::vec2 & value) { glProgramUniform2fv(program, location, 1, &value[0]); }
+};
+template <> struct UniformTraits<glm::vec3> {
+	static bool accepts(GLenum type) { return type == GL_FLOAT_VEC3; }
+	static void upload(GLint location, const glm::vec3 & value) { glUniform3fv(location, 1, &value[0]); }
+	static void uploadTo(GLuint program, GLint location, const glm::vec3 & value) { glProgramUniform3fv(program, location, 1, &value[0]); }
+};
+template <> struct UniformTraits<glm::vec4> {
+	static bool accepts(GLenum type) { return type == GL_FLOAT_VEC4; }
+	static void upload(GLint location, const glm::vec4 & value) { glUniform4fv(location, 1, &value[0]); }
+	static void uploadTo(GLuint program, GLint location, const glm::vec4 & value) { glProgramUniform4fv(program, location, 1, &value[0]); }
+};
+template <> struct UniformTraits<glm::mat3> {
+	static bool accepts(GLenum type) { return type == GL_FLOAT_MAT3; }
+	static void upload(GLint location, const glm::mat3 & value) { glUniformMatrix3fv(location, 1, GL_FALSE, &value[0][0]); }
+	static void uploadTo(GLuint program, GLint location, const glm::mat3 & value) { glProgramUniformMatrix3fv(program, location, 1, GL_FALSE, &value[0][0]); }
+};
+template <> struct UniformTraits<glm::mat4> {
+	static bool accepts(GLenum type) { return type == GL_FLOAT_MAT4; }
+	static void upload(GLint location, const glm::mat4 & value) { glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]); }
+	static void uploadTo(GLuint program, GLint location, const glm::mat4 & value) { glProgramUniformMatrix4fv(program, location, 1, GL_FALSE, &value[0][0]); }
+};
+
+// Handle of a uniform of type T, found once with ShaderProgram::uniform<T>(). Setting an
+// invalid handle (uniform missing, optimized out or of another type) does nothing.
+template <typename T> struct Uniform {
+	size_t index;
+	Uniform() : index((size_t)-1) {}
+	explicit Uniform(size_t i) : index(i) {}
+	bool isValid() const { return index != (size_t)-1; }
+};
+
+// A linked program and what it uses, read once after linking : active uniforms, attributes
+// and uniform blocks. Uniforms are then set through typed handles (an index, no name lookup),
+// and each keeps a copy of its last value so that setting the same value again costs no GL
+// call. The copies assume every write goes through set() ; invalidateShadows() forgets them
+// after a direct glUniform*. set() writes to this program whichever program is in use : through
+// glProgramUniform* when available, otherwise with glUniform* after binding this program if use()
+// did not bind it last. The bound program is tracked, never queried : after a direct glUseProgram,
+// call forgetBoundProgram().
+// Does not own the program (delete it with glDeleteProgram(id()), as after LoadShaders).
+class ShaderProgram {
+public:
+	static const size_t NOT_FOUND = (size_t)-1;
+
+	struct UniformInfo {
+		std::string name;         // Without "[0]" for arrays
+		GLint location;
+		GLenum type;
+		GLint size;               // Array length, 1 otherwise
+		size_t shadowOffset;      // Last value, in shadows
+		bool shadowValid;
+	};
+	struct AttributeInfo {
+		std::string name;
+		GLint location;
+		GLenum type;
+		GLint size;
+	};
+	struct UniformBlockInfo {
+		std::string name;
+		GLuint index;
+		GLint dataSize;           // Bytes the buffer range must at least have
+		GLuint binding;
+	};
+
+	ShaderProgram() : programID(0), directState(false) {}
+	explicit ShaderProgram(GLuint program) { reset(program); }
+
+	// LoadShaders then reflection ; false if the program did not link
+	bool load(const char * vertexPath, const char * fragmentPath);
+	// Reflects an already linked program (from LoadShaders, ShaderCompiler...)
+	void reset(GLuint program);
+
+	GLuint id() const { return programID; }
+	void use() const { glUseProgram(programID); boundProgram = programID; }
+	// The program bound by the last use() may not be bound any more
+	static void forgetBoundProgram() { boundProgram = 0; }
+
+	// Handle of the uniform, invalid (with a message) if the program has no such uniform of type T
+	template <typename T> Uniform<T> uniform(const char * name) const {
+		size_t index = findUniform(name);
+		if (index == NOT_FOUND)
+			return Uniform<T>();
+		if (!UniformTraits<T>::accepts(uniformInfos[index].type)){
+			printf("Uniform %s : wrong type 0x%x\n", name, uniformInfos[index].type);
+			return Uniform<T>();
+		}
+		return Uniform<T>(index);
+	}
+
+	// Uploads value unless it is the last value uploaded through this handle
+	template <typename T> void set(Uniform<T> handle, const T & value){
+		if (!handle.isValid())
+			return;
+		UniformInfo & info = uniformInfos[handle.index];
+		unsigned char * shadow = &shadows[info.shadowOffset];
+		if (info.shadowValid && memcmp(shadow, &value, sizeof(T)) == 0)
+			return;
+		memcpy(shadow, &value, sizeof(T));
+		info.shadowValid = true;
+		if (directState){
+			UniformTraits<T>::uploadTo(programID, info.location, value);
+			return;
+		}
+		// The shadow must never record a write to another program
+		if (boundProgram != programID)
+			use();
+		UniformTraits<T>::upload(info.location, value);
+	}
+
+	void invalidateShadows();
+
+	// Location of the attribute, -1 if it is not active
+	GLint attribute(const char * name) const;
+	// Index in uniformBlocks(), NOT_FOUND if the program has no such block
+	size_t uniformBlock(const char * name) const;
+	// glUniformBlockBinding, skipped if the block already uses binding
+	void bindUniformBlock(size_t block, GLuint binding);
+
+	const std::vector<UniformInfo> & uniforms() const { return uniformInfos; }
+	const std::vector<AttributeInfo> & attributes() const { return attributeInfos; }
+	const std::vector<UniformBlockInfo> & uniformBlocks() const { return blockInfos; }
+
+private:
+	size_t findUniform(const char * name) const;
+
+	static GLuint boundProgram;   // By the last use()
+
+	GLuint programID;
+	bool directState;         // glProgramUniform* available
+	std::vector<UniformInfo> uniformInfos;
+	std::vector<AttributeInfo> attributeInfos;
+	std::vector<UniformBlockInfo> blockInfos;
+	std::vector<unsigned char> shadows;
+};
+
+#endif
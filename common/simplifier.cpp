@@ -0,0 +1,437 @@
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "hashtable.hpp"
+#include "meshoptimizer.hpp"
+#include "simplifier.hpp"
+
+namespace {
+
+// Border and seam edges also get a plane perpendicular to their triangle, weighted this much more
+// than the triangle itself, so the outline resists simplification
+const double BORDER_WEIGHT = 10.0;
+
+// Cosine of the largest rotation a collapse may give a triangle (about 75 degrees)
+const float MAX_NORMAL_CHANGE = 0.25f;
+
+// Sum of squared distances to weighted planes : p^T A p + 2 b^T p + c, A symmetric
+struct Quadric {
+	double a00, a11, a22, a01, a02, a12;
+	double b0, b1, b2;
+	double c;
+	double weight;
+
+	Quadric(){ memset(this, 0, sizeof(*this)); }
+
+	void addPlane(const glm::vec3 & normal, float distance, double w){
+		double x = normal.x, y = normal.y, z = normal.z, d = distance;
+		a00 += w * x * x; a11 += w * y * y; a22 += w * z * z;
+		a01 += w * x * y; a02 += w * x * z; a12 += w * y * z;
+		b0 += w * x * d; b1 += w * y * d; b2 += w * z * d;
+		c += w * d * d;
+		weight += w;
+	}
+
+	void add(const Quadric & q){
+		a00 += q.a00; a11 += q.a11; a22 += q.a22;
+		a01 += q.a01; a02 += q.a02; a12 += q.a12;
+		b0 += q.b0; b1 += q.b1; b2 += q.b2;
+		c += q.c;
+		weight += q.weight;
+	}
+
+	double evaluate(const glm::vec3 & p) const {
+		double x = p.x, y = p.y, z = p.z;
+		return a00 * x * x + a11 * y * y + a22 * z * z
+		     + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+		     + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+	}
+};
+
+enum VertexKind {
+	VERTEX_MANIFOLD,   // Interior vertex : collapses along any edge
+	VERTEX_BORDER,     // On one open border : collapses along it
+	VERTEX_SEAM,       // One of two copies on a seam : collapses along it, with its twin
+	VERTEX_LOCKED      // Never moves
+};
+
+struct Collapse {
+	unsigned int from, to;
+	float error;
+};
+
+class Simplifier {
+public:
+	Simplifier(const std::vector<unsigned int> & indices, const std::vector<glm::vec3> & positions);
+
+	// Simplifies the current indices, see simplifyMesh. Returns the largest error so far.
+	float simplify(size_t targetIndexCount, float targetError);
+
+	std::vector<unsigned int> indices;
+
+private:
+	void findPositionGroups();
+	void classifyVertices();
+	void computeQuadrics();
+	void findOpenEdges();
+	bool hasHalfEdge(unsigned int a, unsigned int b) const;
+	// Twin collapse of a seam collapse from -> to ; false if there is none
+	bool findTwinCollapse(unsigned int from, unsigned int to, unsigned int & twinFrom, unsigned int & twinTo) const;
+	bool canCollapse(unsigned int from, unsigned int to) const;
+	float collapseError(unsigned int from, unsigned int to) const;
+	bool flipsTriangle(unsigned int from, unsigned int to) const;
+	void lockOneRing(unsigned int v);
+
+	const std::vector<glm::vec3> & positions;
+	size_t vertexCount;
+	std::vector<unsigned int> group;   // First vertex with the same position
+	std::vector<unsigned int> wedge;   // Next vertex with the same position, in a circular list
+	std::vector<unsigned char> kind;
+	std::vector<Quadric> quadrics;     // Per position group
+
+	// Rebuilt on every pass
+	TriangleAdjacency adjacency;
+	std::vector<unsigned long long> halfEdges;   // Sorted (a << 32 | b)
+	std::vector<unsigned int> openNext, openPrev;
+	std::vector<unsigned char> openOut, openIn;
+	std::vector<char> locked;
+	float maxError;
+};
+
+Simplifier::Simplifier(const std::vector<unsigned int> & inIndices, const std::vector<glm::vec3> & inPositions)
+	: indices(inIndices), positions(inPositions), vertexCount(inPositions.size()), maxError(0.0f)
+{
+	findPositionGroups();
+	findOpenEdges();
+	classifyVertices();
+	computeQuadrics();
+}
+
+void Simplifier::findPositionGroups(){
+	group.resize(vertexCount);
+	wedge.resize(vertexCount);
+	IdHashTable table(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v){
+		const glm::vec3 & p = positions[v];
+		uint32_t bits[3];
+		memcpy(bits, &p, sizeof(bits));
+		uint32_t first = table.findOrInsert(IdHashTable::hashWords(bits, 3), (uint32_t)v,
+			[&](uint32_t id){ return memcmp(&positions[id], &p, sizeof(glm::vec3)) == 0; });
+		group[v] = first;
+		// Insert v in the circular list of first
+		if (first == v){
+			wedge[v] = (unsigned int)v;
+		}else{
+			wedge[v] = wedge[first];
+			wedge[first] = (unsigned int)v;
+		}
+	}
+}
+
+bool Simplifier::hasHalfEdge(unsigned int a, unsigned int b) const {
+	return std::binary_search(halfEdges.begin(), halfEdges.end(), ((unsigned long long)a << 32) | b);
+}
+
+void Simplifier::findOpenEdges(){
+	const size_t triangleCount = indices.size() / 3;
+	halfEdges.resize(indices.size());
+	for (size_t t = 0; t < triangleCount; ++t)
+		for (int k = 0; k < 3; ++k)
+			halfEdges[3 * t + k] = ((unsigned long long)indices[3 * t + k] << 32) | indices[3 * t + (k + 1) % 3];
+	std::sort(halfEdges.begin(), halfEdges.end());
+
+	// An open edge has no opposite half-edge
+	openNext.assign(vertexCount, 0);
+	openPrev.assign(vertexCount, 0);
+	openOut.assign(vertexCount, 0);
+	openIn.assign(vertexCount, 0);
+	for (size_t i = 0; i < halfEdges.size(); ++i){
+		unsigned int a = (unsigned int)(halfEdges[i] >> 32), b = (unsigned int)halfEdges[i];
+		if (hasHalfEdge(b, a))
+			continue;
+		openNext[a] = b;
+		openPrev[b] = a;
+		if (openOut[a] < 255) ++openOut[a];
+		if (openIn[b] < 255) ++openIn[b];
+	}
+}
+
+void Simplifier::classifyVertices(){
+	// Half-edges between position groups : an edge open between vertices but not between positions
+	// is on a seam
+	std::vector<unsigned long long> groupEdges(halfEdges.size());
+	for (size_t i = 0; i < halfEdges.size(); ++i)
+		groupEdges[i] = ((unsigned long long)group[halfEdges[i] >> 32] << 32) | group[(unsigned int)halfEdges[i]];
+	std::sort(groupEdges.begin(), groupEdges.end());
+	auto openBetweenPositions = [&](unsigned int a, unsigned int b){
+		return !std::binary_search(groupEdges.begin(), groupEdges.end(), ((unsigned long long)group[b] << 32) | group[a]);
+	};
+
+	kind.resize(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v){
+		unsigned int twin = wedge[v];
+		bool onePath = openOut[v] == 1 && openIn[v] == 1;
+		if (twin == v){
+			if (openOut[v] == 0 && openIn[v] == 0)
+				kind[v] = VERTEX_MANIFOLD;
+			else if (onePath && openBetweenPositions((unsigned int)v, openNext[v]) && openBetweenPositions(openPrev[v], (unsigned int)v))
+				kind[v] = VERTEX_BORDER;
+			else
+				kind[v] = VERTEX_LOCKED;   // Next to where several seams meet, or non-manifold
+		}else if (wedge[twin] == v && onePath && openOut[twin] == 1 && openIn[twin] == 1
+		          && group[openNext[v]] == group[openPrev[twin]] && group[openPrev[v]] == group[openNext[twin]]){
+			// Two copies whose open edges run along each other in opposite directions
+			kind[v] = VERTEX_SEAM;
+		}else{
+			kind[v] = VERTEX_LOCKED;
+		}
+	}
+}
+
+void Simplifier::computeQuadrics(){
+	quadrics.assign(vertexCount, Quadric());
+	for (size_t t = 0; t < indices.size() / 3; ++t){
+		const unsigned int * triangle = &indices[3 * t];
+		const glm::vec3 & p0 = positions[triangle[0]];
+		const glm::vec3 & p1 = positions[triangle[1]];
+		const glm::vec3 & p2 = positions[triangle[2]];
+		glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(n);
+		if (length == 0.0f)
+			continue;
+		n /= length;
+		Quadric q;
+		q.addPlane(n, -glm::dot(n, p0), 0.5 * length);
+		for (int k = 0; k < 3; ++k)
+			quadrics[group[triangle[k]]].add(q);
+
+		for (int k = 0; k < 3; ++k){
+			unsigned int a = triangle[k], b = triangle[(k + 1) % 3];
+			if (hasHalfEdge(b, a))
+				continue;
+			glm::vec3 edge = positions[b] - positions[a];
+			glm::vec3 normal = glm::cross(edge, n);
+			float normalLength = glm::length(normal);
+			if (normalLength == 0.0f)
+				continue;
+			normal /= normalLength;
+			Quadric border;
+			border.addPlane(normal, -glm::dot(normal, positions[a]), BORDER_WEIGHT * glm::dot(edge, edge));
+			// The error is normalized by the surface area only : moving a border is not made cheaper
+			// by the weight of its own planes
+			border.weight = 0.0;
+			quadrics[group[a]].add(border);
+			quadrics[group[b]].add(border);
+		}
+	}
+}
+
+bool Simplifier::findTwinCollapse(unsigned int from, unsigned int to, unsigned int & twinFrom, unsigned int & twinTo) const {
+	twinFrom = wedge[from];
+	if (openOut[twinFrom] != 1 || openIn[twinFrom] != 1)
+		return false;
+	if (group[openNext[twinFrom]] == group[to])
+		twinTo = openNext[twinFrom];
+	else if (group[openPrev[twinFrom]] == group[to])
+		twinTo = openPrev[twinFrom];
+	else
+		return false;
+	return true;
+}
+
+bool Simplifier::canCollapse(unsigned int from, unsigned int to) const {
+	if (group[from] == group[to])
+		return false;
+	switch (kind[from]){
+	case VERTEX_MANIFOLD:
+		return true;
+	case VERTEX_BORDER:
+	case VERTEX_SEAM:
+		if (openOut[from] != 1 || openIn[from] != 1 || (openNext[from] != to && openPrev[from] != to))
+			return false;
+		if (kind[from] == VERTEX_SEAM){
+			unsigned int twinFrom, twinTo;
+			return findTwinCollapse(from, to, twinFrom, twinTo);
+		}
+		return true;
+	default:
+		return false;
+	}
+}
+
+float Simplifier::collapseError(unsigned int from, unsigned int to) const {
+	Quadric q = quadrics[group[from]];
+	q.add(quadrics[group[to]]);
+	double error = q.weight > 0.0 ? q.evaluate(positions[to]) / q.weight : 0.0;
+	return (float)sqrt(std::max(error, 0.0));
+}
+
+bool Simplifier::flipsTriangle(unsigned int from, unsigned int to) const {
+	const unsigned int * list = &adjacency.triangles[adjacency.offsets[from]];
+	for (unsigned int j = 0; j < adjacency.counts[from]; ++j){
+		const unsigned int * triangle = &indices[3 * list[j]];
+		if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+			continue;   // Collapses to nothing
+		glm::vec3 p[3], moved[3];
+		for (int k = 0; k < 3; ++k){
+			p[k] = positions[triangle[k]];
+			moved[k] = triangle[k] == from ? positions[to] : p[k];
+		}
+		glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+		glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+		// Also reject large rotations, which add up over successive collapses into flips
+		if (glm::dot(before, after) <= MAX_NORMAL_CHANGE * glm::length(before) * glm::length(after))
+			return true;
+	}
+	return false;
+}
+
+void Simplifier::lockOneRing(unsigned int v){
+	const unsigned int * list = &adjacency.triangles[adjacency.offsets[v]];
+	for (unsigned int j = 0; j < adjacency.counts[v]; ++j)
+		for (int k = 0; k < 3; ++k)
+			locked[indices[3 * list[j] + k]] = 1;
+}
+
+float Simplifier::simplify(size_t targetIndexCount, float targetError){
+	std::vector<Collapse> collapses;
+	std::vector<unsigned int> target;
+	while (indices.size() > targetIndexCount){
+		buildTriangleAdjacency(adjacency, indices, vertexCount);
+		findOpenEdges();
+
+		// Every valid direction of every edge, cheapest first
+		collapses.clear();
+		for (size_t i = 0; i < halfEdges.size(); ++i){
+			unsigned int a = (unsigned int)(halfEdges[i] >> 32), b = (unsigned int)halfEdges[i];
+			bool open = !hasHalfEdge(b, a);
+			if (canCollapse(a, b)){
+				Collapse c = { a, b, collapseError(a, b) };
+				collapses.push_back(c);
+			}
+			// Interior edges are seen from both sides, open ones only once
+			if (open && canCollapse(b, a)){
+				Collapse c = { b, a, collapseError(b, a) };
+				collapses.push_back(c);
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse & x, const Collapse & y){ return x.error < y.error; });
+
+		// Apply the ones that do not touch each other's neighbourhood
+		locked.assign(vertexCount, 0);
+		target.resize(vertexCount);
+		for (size_t v = 0; v < vertexCount; ++v) target[v] = (unsigned int)v;
+		size_t triangleCount = indices.size() / 3;
+		const size_t targetTriangleCount = targetIndexCount / 3;
+		size_t applied = 0;
+		for (size_t i = 0; i < collapses.size() && triangleCount > targetTriangleCount; ++i){
+			const Collapse & c = collapses[i];
+			if (c.error > targetError)
+				break;
+			unsigned int twinFrom = c.from, twinTo = c.to;
+			if (kind[c.from] == VERTEX_SEAM)
+				findTwinCollapse(c.from, c.to, twinFrom, twinTo);
+			if (locked[c.from] || locked[c.to] || locked[twinFrom] || locked[twinTo])
+				continue;
+			if (flipsTriangle(c.from, c.to) || (twinFrom != c.from && flipsTriangle(twinFrom, twinTo)))
+				continue;
+
+			target[c.from] = c.to;
+			target[twinFrom] = twinTo;
+			quadrics[group[c.to]].add(quadrics[group[c.from]]);
+			lockOneRing(c.from);
+			lockOneRing(twinFrom);
+			// Triangles around the edge disappear
+			const unsigned int * list = &adjacency.triangles[adjacency.offsets[c.from]];
+			for (unsigned int j = 0; j < adjacency.counts[c.from]; ++j){
+				const unsigned int * triangle = &indices[3 * list[j]];
+				if (triangle[0] == c.to || triangle[1] == c.to || triangle[2] == c.to) --triangleCount;
+			}
+			if (twinFrom != c.from){
+				list = &adjacency.triangles[adjacency.offsets[twinFrom]];
+				for (unsigned int j = 0; j < adjacency.counts[twinFrom]; ++j){
+					const unsigned int * triangle = &indices[3 * list[j]];
+					if (triangle[0] == twinTo || triangle[1] == twinTo || triangle[2] == twinTo) --triangleCount;
+				}
+			}
+			maxError = std::max(maxError, c.error);
+			++applied;
+		}
+		if (applied == 0)
+			break;
+
+		// Rewrite the triangles, dropping the degenerate ones
+		size_t write = 0;
+		for (size_t i = 0; i < indices.size(); i += 3){
+			unsigned int a = target[indices[i]], b = target[indices[i + 1]], c = target[indices[i + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+			indices[write++] = a;
+			indices[write++] = b;
+			indices[write++] = c;
+		}
+		indices.resize(write);
+	}
+	return maxError;
+}
+
+} // namespace
+
+float simplifyMesh(
+	std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & positions,
+	size_t targetIndexCount,
+	float targetError
+){
+	Simplifier simplifier(indices, positions);
+	float error = simplifier.simplify(targetIndexCount, targetError);
+	indices.swap(simplifier.indices);
+	return error;
+}
+
+void buildLodChain(
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & positions,
+	const std::vector<float> & ratios,
+	std::vector<unsigned int> & lodIndices,
+	std::vector<MeshLod> & lods
+){
+	lodIndices = indices;
+	lods.clear();
+	MeshLod full = { 0, (unsigned int)indices.size(), 0.0f };
+	lods.push_back(full);
+
+	// One simplifier for the whole chain : its quadrics keep accumulating, so the error of each
+	// LOD is measured against the original mesh
+	Simplifier simplifier(indices, positions);
+	for (size_t i = 0; i < ratios.size(); ++i){
+		size_t target = (size_t)(indices.size() / 3 * ratios[i]) * 3;
+		float error = simplifier.simplify(target, 1e30f);
+		if (simplifier.indices.size() >= lods.back().indexCount)
+			break;
+		MeshLod lod = { (unsigned int)lodIndices.size(), (unsigned int)simplifier.indices.size(), error };
+		lodIndices.insert(lodIndices.end(), simplifier.indices.begin(), simplifier.indices.end());
+		lods.push_back(lod);
+	}
+}
+
+size_t selectLod(
+	const std::vector<MeshLod> & lods,
+	float distance,
+	const glm::mat4 & Projection,
+	float viewportHeight,
+	float maxPixelError
+){
+	// Projection[1][1] is 1 / tan(fovY / 2) : a length l at distance d covers l * Projection[1][1] / d
+	// half-viewports
+	const float pixelsPerUnit = Projection[1][1] * viewportHeight * 0.5f / std::max(distance, 1e-6f);
+	size_t selected = 0;
+	for (size_t i = 1; i < lods.size(); ++i)
+		if (lods[i].error * pixelsPerUnit <= maxPixelError)
+			selected = i;
+	return selected;
+}
@@ -0,0 +1,56 @@
+#ifndef SIMPLIFIER_HPP
+#define SIMPLIFIER_HPP
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Quadric error metric simplification (Garland & Heckbert) of indexed triangle lists.
+// Edges are collapsed onto one of their existing vertices, so the vertex streams stay valid and
+// are shared by every level of detail : only the index buffer changes.
+//
+// Vertices with the same position but different attributes (uv or normal seams) and vertices on
+// open borders only slide along their seam / border, onto a vertex of it, and both sides of a seam
+// collapse together, so seams never open and borders keep their outline. Vertices where more than
+// two seams meet, or with a non-manifold neighbourhood, never move.
+
+// Simplifies indices until at most targetIndexCount indices are left, or until the next collapse
+// would move the surface by more than targetError (in model space units). Returns the error
+// reached, in the same units.
+float simplifyMesh(
+	std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & positions,
+	size_t targetIndexCount,
+	float targetError = 1e30f
+);
+
+// One level of detail : a range of the LOD index buffer
+struct MeshLod {
+	unsigned int indexOffset;
+	unsigned int indexCount;
+	float error;   // Geometric error in model space units, 0 for the full resolution mesh
+};
+
+// Builds LOD 0 (the mesh itself) and one LOD per ratio of the original triangle count
+// (e.g. 0.5, 0.25, 0.125), each one simplified from the previous, into a single index buffer.
+// The chain stops early if the mesh cannot be simplified further.
+void buildLodChain(
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & positions,
+	const std::vector<float> & ratios,
+	std::vector<unsigned int> & lodIndices,
+	std::vector<MeshLod> & lods
+);
+
+// Picks the coarsest LOD whose error, projected on screen, stays under maxPixelError pixels.
+// distance is from the camera to the mesh, in model space units ; Projection is the projection
+// matrix and viewportHeight is in pixels. A crowded scene can trade quality for speed by
+// raising maxPixelError.
+size_t selectLod(
+	const std::vector<MeshLod> & lods,
+	float distance,
+	const glm::mat4 & Projection,
+	float viewportHeight,
+	float maxPixelError = 1.0f
+);
+
+#endif
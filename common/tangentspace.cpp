@@ -1,7 +1,14 @@
 #include <vector>
+#include <cmath>
 #include <glm/glm.hpp>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TANGENTSPACE_SSE2
+#include <emmintrin.h>
+#endif
+
 #include "tangentspace.hpp"
+#include "parallel.hpp"
 
 void computeTangentBasis(
 	// inputs
@@ -70,4 +77,163 @@ void computeTangentBasis(
 
 }
 
+namespace {
+
+// Any unit vector perpendicular to n, for vertices whose uvs give no direction
+glm::vec3 anyPerpendicular(const glm::vec3 & n){
+	glm::vec3 axis = fabsf(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	return glm::normalize(glm::cross(n, axis));
+}
+
+glm::vec3 projectAndNormalize(const glm::vec3 & v, const glm::vec3 & n){
+	glm::vec3 projected = v - n * glm::dot(n, v);
+	float length2 = glm::dot(projected, projected);
+	return length2 > 1e-20f ? projected / sqrtf(length2) : glm::vec3(0.0f);
+}
+
+// Gram-Schmidt orthonormalization of the summed tangents t against the normals n, and handedness
+// from the summed bitangents b, for vertices [begin, end)
+void orthonormalizeTangents(size_t begin, size_t end, const glm::vec3 * n, const glm::vec3 * t, const glm::vec3 * b, glm::vec4 * out){
+	size_t i = begin;
+#ifdef TANGENTSPACE_SSE2
+	// 4 vertices at a time, one component per register
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	const __m128 epsilon = _mm_set1_ps(1e-20f);
+	for (; i + 4 <= end; i += 4){
+		__m128 nx = _mm_setr_ps(n[i].x, n[i + 1].x, n[i + 2].x, n[i + 3].x);
+		__m128 ny = _mm_setr_ps(n[i].y, n[i + 1].y, n[i + 2].y, n[i + 3].y);
+		__m128 nz = _mm_setr_ps(n[i].z, n[i + 1].z, n[i + 2].z, n[i + 3].z);
+		__m128 tx = _mm_setr_ps(t[i].x, t[i + 1].x, t[i + 2].x, t[i + 3].x);
+		__m128 ty = _mm_setr_ps(t[i].y, t[i + 1].y, t[i + 2].y, t[i + 3].y);
+		__m128 tz = _mm_setr_ps(t[i].z, t[i + 1].z, t[i + 2].z, t[i + 3].z);
+		__m128 bx = _mm_setr_ps(b[i].x, b[i + 1].x, b[i + 2].x, b[i + 3].x);
+		__m128 by = _mm_setr_ps(b[i].y, b[i + 1].y, b[i + 2].y, b[i + 3].y);
+		__m128 bz = _mm_setr_ps(b[i].z, b[i + 1].z, b[i + 2].z, b[i + 3].z);
+
+		// t -= n * dot(n, t)
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, tx), _mm_mul_ps(ny, ty)), _mm_mul_ps(nz, tz));
+		tx = _mm_sub_ps(tx, _mm_mul_ps(nx, d));
+		ty = _mm_sub_ps(ty, _mm_mul_ps(ny, d));
+		tz = _mm_sub_ps(tz, _mm_mul_ps(nz, d));
+		// Normalize, leaving degenerate tangents at zero for the fix-up below
+		__m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(ty, ty)), _mm_mul_ps(tz, tz));
+		__m128 valid = _mm_cmpgt_ps(length2, epsilon);
+		__m128 inverse = _mm_and_ps(valid, _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(length2, epsilon))));
+		tx = _mm_mul_ps(tx, inverse);
+		ty = _mm_mul_ps(ty, inverse);
+		tz = _mm_mul_ps(tz, inverse);
+		// w = dot(cross(n, t), b) < 0 ? -1 : 1
+		__m128 cx = _mm_sub_ps(_mm_mul_ps(ny, tz), _mm_mul_ps(nz, ty));
+		__m128 cy = _mm_sub_ps(_mm_mul_ps(nz, tx), _mm_mul_ps(nx, tz));
+		__m128 cz = _mm_sub_ps(_mm_mul_ps(nx, ty), _mm_mul_ps(ny, tx));
+		__m128 handedness = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, bx), _mm_mul_ps(cy, by)), _mm_mul_ps(cz, bz));
+		__m128 w = _mm_or_ps(one, _mm_and_ps(signBit, _mm_cmplt_ps(handedness, zero)));
+
+		float x[4], y[4], z[4], s[4];
+		_mm_storeu_ps(x, tx);
+		_mm_storeu_ps(y, ty);
+		_mm_storeu_ps(z, tz);
+		_mm_storeu_ps(s, w);
+		int validMask = _mm_movemask_ps(valid);
+		for (int k = 0; k < 4; ++k){
+			glm::vec3 tangent = (validMask & (1 << k)) ? glm::vec3(x[k], y[k], z[k]) : anyPerpendicular(n[i + k]);
+			out[i + k] = glm::vec4(tangent, s[k]);
+		}
+	}
+#endif
+	// Same operations, in the same order, as one SIMD lane : the result does not depend on where the
+	// blocks start
+	for (; i < end; ++i){
+		glm::vec3 tangent = t[i] - n[i] * glm::dot(n[i], t[i]);
+		float length2 = glm::dot(tangent, tangent);
+		if (length2 > 1e-20f)
+			tangent *= 1.0f / sqrtf(length2);
+		else
+			tangent = anyPerpendicular(n[i]);
+		float w = glm::dot(glm::cross(n[i], tangent), b[i]) < 0.0f ? -1.0f : 1.0f;
+		out[i] = glm::vec4(tangent, w);
+	}
+}
+
+} // namespace
+
+void computeTangentBasisIndexed(
+	// inputs
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	// outputs
+	std::vector<glm::vec4> & tangents,
+	TangentWeighting weighting
+){
+	const size_t vertexCount = vertices.size();
+	const size_t triangleCount = indices.size() / 3;
+	const size_t MIN_BLOCK = 1 << 12;
+	tangents.resize(vertexCount);
+	if (vertexCount == 0)
+		return;
+
+	// 1. Weighted tangent and bitangent of every triangle corner, in parallel over triangles
+	std::vector<glm::vec3> cornerTangents(3 * triangleCount), cornerBitangents(3 * triangleCount);
+	parallelForBlocks(triangleCount, MIN_BLOCK, [&](size_t begin, size_t end){
+		for (size_t t = begin; t < end; ++t){
+			const unsigned int * triangle = &indices[3 * t];
+			const glm::vec3 p[3] = { vertices[triangle[0]], vertices[triangle[1]], vertices[triangle[2]] };
+			const glm::vec2 uv[3] = { uvs[triangle[0]], uvs[triangle[1]], uvs[triangle[2]] };
+
+			// Same derivation as computeTangentBasis above
+			glm::vec3 deltaPos1 = p[1] - p[0];
+			glm::vec3 deltaPos2 = p[2] - p[0];
+			glm::vec2 deltaUV1 = uv[1] - uv[0];
+			glm::vec2 deltaUV2 = uv[2] - uv[0];
+			float determinant = deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x;
+			float r = determinant != 0.0f ? 1.0f / determinant : 0.0f;
+			glm::vec3 tangent = (deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y) * r;
+			glm::vec3 bitangent = (deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x) * r;
+			float area = 0.5f * glm::length(glm::cross(deltaPos1, deltaPos2));
+
+			for (int k = 0; k < 3; ++k){
+				const glm::vec3 & n = normals[triangle[k]];
+				float weight = area;
+				if (weighting == TANGENT_WEIGHT_ANGLE){
+					glm::vec3 e1 = p[(k + 1) % 3] - p[k], e2 = p[(k + 2) % 3] - p[k];
+					float lengths = glm::length(e1) * glm::length(e2);
+					weight = lengths > 0.0f ? acosf(glm::clamp(glm::dot(e1, e2) / lengths, -1.0f, 1.0f)) : 0.0f;
+				}
+				cornerTangents[3 * t + k] = projectAndNormalize(tangent, n) * weight;
+				cornerBitangents[3 * t + k] = projectAndNormalize(bitangent, n) * weight;
+			}
+		}
+	});
+
+	// 2. Corners of every vertex, in corner order (counting sort)
+	std::vector<unsigned int> cornerStart(vertexCount + 1, 0);
+	for (size_t i = 0; i < indices.size(); ++i)
+		++cornerStart[indices[i] + 1];
+	for (size_t v = 0; v < vertexCount; ++v)
+		cornerStart[v + 1] += cornerStart[v];
+	std::vector<unsigned int> corners(indices.size());
+	{
+		std::vector<unsigned int> filled(cornerStart.begin(), cornerStart.end() - 1);
+		for (size_t i = 0; i < indices.size(); ++i)
+			corners[filled[indices[i]]++] = (unsigned int)i;
+	}
 
+	// 3. Sum the corners of every vertex, always in the same order, then orthonormalize
+	std::vector<glm::vec3> tangentSums(vertexCount), bitangentSums(vertexCount);
+	parallelForBlocks(vertexCount, MIN_BLOCK, [&](size_t begin, size_t end){
+		for (size_t v = begin; v < end; ++v){
+			glm::vec3 t(0.0f), b(0.0f);
+			for (unsigned int c = cornerStart[v]; c < cornerStart[v + 1]; ++c){
+				t += cornerTangents[corners[c]];
+				b += cornerBitangents[corners[c]];
+			}
+			tangentSums[v] = t;
+			bitangentSums[v] = b;
+		}
+		orthonormalizeTangents(begin, end, &normals[0], &tangentSums[0], &bitangentSums[0], &tangents[0]);
+	});
+}
@@ -11,5 +11,27 @@ void computeTangentBasis(
 	std::vector<glm::vec3> & bitangents
 );
 
+enum TangentWeighting {
+	TANGENT_WEIGHT_ANGLE,   // By the angle of the triangle at the vertex, as MikkTSpace does
+	TANGENT_WEIGHT_AREA     // By the area of the triangle
+};
+
+// Tangent basis of an indexed mesh, one tangent per vertex, following MikkTSpace's conventions :
+// each triangle's tangent and bitangent are projected on the plane of the vertex normal, normalized
+// and weighted, then summed over the triangles sharing the vertex.
+// tangents[i].w is the handedness, so the shader rebuilds the bitangent as
+// cross(normal, tangent.xyz) * tangent.w.
+// Runs on workerThreadCount() threads ; the result does not depend on their number.
+void computeTangentBasisIndexed(
+	// inputs
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	// outputs
+	std::vector<glm::vec4> & tangents,
+	TangentWeighting weighting = TANGENT_WEIGHT_ANGLE
+);
+
 
 #endif
\ No newline at end of file
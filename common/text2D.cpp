@@ -33,6 +33,11 @@ void initText2D(const char * texturePath){
 	// Initialize uniforms' IDs
 	Text2DUniformID = glGetUniformLocation( Text2DShaderID, "myTextureSampler" );
 
+	// Set our "myTextureSampler" sampler to user Texture Unit 0, once and for all : the program keeps it
+	glUseProgram(Text2DShaderID);
+	glUniform1i(Text2DUniformID, 0);
+	glUseProgram(0);
+
 }
 
 void printText2D(const char * text, int x, int y, int size){
@@ -78,14 +83,12 @@ void printText2D(const char * text, int x, int y, int size){
 	glBindBuffer(GL_ARRAY_BUFFER, Text2DUVBufferID);
 	glBufferData(GL_ARRAY_BUFFER, UVs.size() * sizeof(glm::vec2), &UVs[0], GL_STATIC_DRAW);
 
-	// Bind shader
+	// Bind shader ; the sampler was set up by initText2D
 	glUseProgram(Text2DShaderID);
 
 	// Bind texture
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, Text2DTextureID);
-	// Set our "myTextureSampler" sampler to user Texture Unit 0
-	glUniform1i(Text2DUniformID, 0);
 
 	// 1rst attribute buffer : vertices
 	glEnableVertexAttribArray(0);
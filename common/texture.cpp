@@ -6,59 +6,81 @@
 
 #include <glfw3.h>
 
+#include <vector>
 
-GLuint loadBMP_custom(const char * imagepath){
-
-	printf("Reading image %s\n", imagepath);
+#include "mappedfile.hpp"
+#include "mipmap.hpp"
+#include "texture.hpp"
 
-	// Data read from the header of the BMP file
-	unsigned char header[54];
-	unsigned int dataPos;
-	unsigned int imageSize;
-	unsigned int width, height;
-	// Actual RGB data
-	unsigned char * data;
 
-	// Open the file
-	FILE * file = fopen(imagepath,"rb");
-	if (!file)							    {printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath); getchar(); return 0;}
-
-	// Read the header, i.e. the 54 first bytes
+// BMP and DDS fields are little-endian and not always aligned in the file
+static unsigned int readLE32(const unsigned char * p){
+	return (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
 
-	// If less than 54 bytes are read, problem
-	if ( fread(header, 1, 54, file)!=54 ){ 
-		printf("Not a correct BMP file\n");
-		fclose(file);
-		return 0;
+bool decodeBMP(const char * path, const unsigned char * data, size_t size, BmpImage & image){
+	// Data read from the header of the BMP file, i.e. the 54 first bytes
+	// If less than 54 bytes are there, problem
+	if (size < 54){
+		printf("%s: not a correct BMP file\n", path);
+		return false;
 	}
+	const unsigned char * header = data;
 	// A BMP files always begins with "BM"
 	if ( header[0]!='B' || header[1]!='M' ){
-		printf("Not a correct BMP file\n");
-		fclose(file);
-		return 0;
+		printf("%s: not a correct BMP file\n", path);
+		return false;
+	}
+	// Make sure this is an uncompressed 24bpp file
+	if ( readLE32(&header[0x1E])!=0 || (header[0x1C] | (header[0x1D] << 8))!=24 ){
+		printf("%s: not a 24 bits uncompressed BMP file\n", path);
+		return false;
 	}
-	// Make sure this is a 24bpp file
-	if ( *(int*)&(header[0x1E])!=0  )         {printf("Not a correct BMP file\n");    fclose(file); return 0;}
-	if ( *(int*)&(header[0x1C])!=24 )         {printf("Not a correct BMP file\n");    fclose(file); return 0;}
 
 	// Read the information about the image
-	dataPos    = *(int*)&(header[0x0A]);
-	imageSize  = *(int*)&(header[0x22]);
-	width      = *(int*)&(header[0x12]);
-	height     = *(int*)&(header[0x16]);
-
+	unsigned int dataPos = readLE32(&header[0x0A]);
+	image.width  = readLE32(&header[0x12]);
+	image.height = readLE32(&header[0x16]);
 	// Some BMP files are misformatted, guess missing information
-	if (imageSize==0)    imageSize=width*height*3; // 3 : one byte for each Red, Green and Blue component
 	if (dataPos==0)      dataPos=54; // The BMP header is done that way
 
-	// Create a buffer
-	data = new unsigned char [imageSize];
+	// Rows are bottom-up, like OpenGL wants them, and padded to 4 bytes
+	// (top-down files have a negative height)
+	image.rowBytes = ((size_t)image.width * 3 + 3) & ~(size_t)3;
+	if ((int)image.height <= 0 || (int)image.width <= 0 ||
+		dataPos > size || (size - dataPos) / image.rowBytes < image.height){
+		printf("%s: unsupported or truncated BMP file\n", path);
+		return false;
+	}
+	image.pixels = data + dataPos;
+	return true;
+}
+
+void expandBMPPixels(const BmpImage & image, bool rgba, unsigned char * pixels){
+	const int red = rgba ? 0 : 2, blue = rgba ? 2 : 0;
+	for (unsigned int y = 0; y < image.height; ++y){
+		const unsigned char * source = image.pixels + y * image.rowBytes;
+		unsigned char * destination = pixels + (size_t)y * image.width * 4;
+		for (unsigned int x = 0; x < image.width; ++x){
+			destination[4 * x + red] = source[3 * x + 2];
+			destination[4 * x + 1] = source[3 * x + 1];
+			destination[4 * x + blue] = source[3 * x + 0];
+			destination[4 * x + 3] = 255;
+		}
+	}
+}
+
+GLuint loadBMP_custom(const char * imagepath){
+
+	printf("Reading image %s\n", imagepath);
 
-	// Read the actual data from the file into the buffer
-	fread(data,1,imageSize,file);
+	// Map the file : the pixels are read straight from the mapping, without a copy
+	MappedFile file;
+	if (!file.open(imagepath))				    {printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath); getchar(); return 0;}
 
-	// Everything is in memory now, the file wan be closed
-	fclose (file);
+	BmpImage image;
+	if (!decodeBMP(imagepath, (const unsigned char *)file.data(), file.size(), image))
+		return 0;
 
 	// Create one OpenGL texture
 	GLuint textureID;
@@ -67,12 +89,16 @@ GLuint loadBMP_custom(const char * imagepath){
 	// "Bind" the newly created texture : all future texture functions will modify this texture
 	glBindTexture(GL_TEXTURE_2D, textureID);
 
-	// Give the image to OpenGL
-	glTexImage2D(GL_TEXTURE_2D, 0,GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
+	// Give the image and its mipmaps to OpenGL. The mipmaps are box filtered on the CPU (in
+	// parallel) instead of by glGenerateMipmap, like TextureLoader does ; BGRA uploads without
+	// conversion on most drivers.
+	std::vector<unsigned char> pixels((size_t)image.width * image.height * 4);
+	expandBMPPixels(image, false, &pixels[0]);
+	MipChain mips;
+	generateMipChain(&pixels[0], image.width, image.height, MIP_FILTER_BOX, false, mips);
+	uploadMipChain(mips, GL_BGRA, false);
 
-	// OpenGL has now copied the data. Free our own version
-	delete [] data;
-	fclose(file);
+	// OpenGL has now copied the data ; the file is unmapped when file goes out of scope
 
 	// Poor filtering, or ...
 	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -83,7 +109,6 @@ GLuint loadBMP_custom(const char * imagepath){
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); 
-	glGenerateMipmap(GL_TEXTURE_2D);
 
 	// Return the ID of the texture we just created
 	return textureID;
@@ -120,63 +145,62 @@ GLuint loadBMP_custom(const char * imagepath){
 #define FOURCC_DXT3 0x33545844 // Equivalent to "DXT3" in ASCII
 #define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
 
-GLuint loadDDS(const char * imagepath){
+bool decodeDDS(const char * path, const unsigned char * data, size_t size, DdsImage & image){
+	// "DDS " then a 124 bytes header
+	if (size < 128 || strncmp((const char *)data, "DDS ", 4) != 0){
+		printf("%s: not a correct DDS file\n", path);
+		return false;
+	}
+	const unsigned char * header = data + 4;
+	image.height = readLE32(&header[8]);
+	image.width = readLE32(&header[12]);
+	unsigned int mipMapCount = readLE32(&header[24]);
+	unsigned int fourCC = readLE32(&header[80]);
+	switch (fourCC){
+	case FOURCC_DXT1: image.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; image.blockSize = 8; break;
+	case FOURCC_DXT3: image.format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; image.blockSize = 16; break;
+	case FOURCC_DXT5: image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; image.blockSize = 16; break;
+	default:
+		printf("%s: not a DXT1, DXT3 or DXT5 DDS file\n", path);
+		return false;
+	}
+	if (image.width == 0 || image.height == 0 || image.width > 32768 || image.height > 32768){
+		printf("%s: unsupported DDS dimensions\n", path);
+		return false;
+	}
 
-	unsigned char header[124];
+	// No mipmap count means a single level ; never more levels than down to 1x1
+	unsigned int fullCount = 1;
+	while ((image.width >> fullCount) > 0 || (image.height >> fullCount) > 0)
+		++fullCount;
+	image.levelCount = mipMapCount == 0 ? 1 : (mipMapCount < fullCount ? mipMapCount : fullCount);
+	image.data = data + 128;
+
+	size_t needed = 0;
+	for (unsigned int level = 0; level < image.levelCount; ++level)
+		needed += image.levelSize(level);
+	if (size - 128 < needed){
+		printf("%s: truncated DDS file\n", path);
+		return false;
+	}
+	return true;
+}
+
+GLuint loadDDS(const char * imagepath){
 
-	FILE *fp; 
- 
-	/* try to open the file */ 
-	fp = fopen(imagepath, "rb"); 
-	if (fp == NULL){
+	/* map the file ; the levels are uploaded straight from the mapping */ 
+	MappedFile file;
+	if (!file.open(imagepath)){
 		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath); getchar(); 
 		return 0;
 	}
-   
-	/* verify the type of file */ 
-	char filecode[4]; 
-	fread(filecode, 1, 4, fp); 
-	if (strncmp(filecode, "DDS ", 4) != 0) { 
-		fclose(fp); 
-		return 0; 
-	}
-	
-	/* get the surface desc */ 
-	fread(&header, 124, 1, fp); 
-
-	unsigned int height      = *(unsigned int*)&(header[8 ]);
-	unsigned int width	     = *(unsigned int*)&(header[12]);
-	unsigned int linearSize	 = *(unsigned int*)&(header[16]);
-	unsigned int mipMapCount = *(unsigned int*)&(header[24]);
-	unsigned int fourCC      = *(unsigned int*)&(header[80]);
-
- 
-	unsigned char * buffer;
-	unsigned int bufsize;
-	/* how big is it going to be including all mipmaps? */ 
-	bufsize = mipMapCount > 1 ? linearSize * 2 : linearSize; 
-	buffer = (unsigned char*)malloc(bufsize * sizeof(unsigned char)); 
-	fread(buffer, 1, bufsize, fp); 
-	/* close the file pointer */ 
-	fclose(fp);
-
-	unsigned int components  = (fourCC == FOURCC_DXT1) ? 3 : 4; 
-	unsigned int format;
-	switch(fourCC) 
-	{ 
-	case FOURCC_DXT1: 
-		format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; 
-		break; 
-	case FOURCC_DXT3: 
-		format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; 
-		break; 
-	case FOURCC_DXT5: 
-		format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; 
-		break; 
-	default: 
-		free(buffer); 
-		return 0; 
-	}
+
+	/* verify the type of file, and that every level is there. The level sizes come from the
+	   dimensions : linearSize * 2 was a guess of the size of the mipmaps, which reads past the
+	   end of small files and cuts the chain of others */ 
+	DdsImage image;
+	if (!decodeDDS(imagepath, (const unsigned char *)file.data(), file.size(), image))
+		return 0;
 
 	// Create one OpenGL texture
 	GLuint textureID;
@@ -186,27 +210,16 @@ GLuint loadDDS(const char * imagepath){
 	glBindTexture(GL_TEXTURE_2D, textureID);
 	glPixelStorei(GL_UNPACK_ALIGNMENT,1);	
 	
-	unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16; 
-	unsigned int offset = 0;
-
 	/* load the mipmaps */ 
-	for (unsigned int level = 0; level < mipMapCount && (width || height); ++level) 
+	const unsigned char * level = image.data;
+	for (unsigned int l = 0; l < image.levelCount; ++l) 
 	{ 
-		unsigned int size = ((width+3)/4)*((height+3)/4)*blockSize; 
-		glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height,  
-			0, size, buffer + offset); 
-	 
-		offset += size; 
-		width  /= 2; 
-		height /= 2; 
-
-		// Deal with Non-Power-Of-Two textures. This code is not included in the webpage to reduce clutter.
-		if(width < 1) width = 1;
-		if(height < 1) height = 1;
-
+		glCompressedTexImage2D(GL_TEXTURE_2D, l, image.format, image.levelWidth(l), image.levelHeight(l),  
+			0, (GLsizei)image.levelSize(l), level); 
+		level += image.levelSize(l); 
 	} 
-
-	free(buffer); 
+	// A file without the whole chain is still complete
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.levelCount - 1);
 
 	return textureID;
 
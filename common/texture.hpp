@@ -1,9 +1,43 @@
 #ifndef TEXTURE_HPP
 #define TEXTURE_HPP
 
+#include <cstddef>
+
 // Load a .BMP file using our custom loader
 GLuint loadBMP_custom(const char * imagepath);
 
+// Pixels of a 24 bits uncompressed BMP file : BGR, bottom row first, rows padded to 4 bytes
+struct BmpImage {
+	unsigned int width, height;
+	size_t rowBytes;
+	const unsigned char * pixels;   // Points into the file data given to decodeBMP
+};
+
+// Checks the header of a BMP file held in memory (e.g. a MappedFile) and locates its pixels.
+// Prints why and returns false for anything else than a 24 bits uncompressed BMP, or a truncated one.
+bool decodeBMP(const char * path, const unsigned char * data, size_t size, BmpImage & image);
+
+// Copies the pixels to width * height * 4 bytes, BGRA (or RGBA) with alpha 255, rows unpadded and
+// still bottom row first
+void expandBMPPixels(const BmpImage & image, bool rgba, unsigned char * pixels);
+
+// Compressed levels of a DXT1/DXT3/DXT5 DDS file, level 0 first, each one right after the previous
+struct DdsImage {
+	unsigned int width, height;     // Of level 0
+	unsigned int format;            // GL_COMPRESSED_RGBA_S3TC_DXTn_EXT
+	unsigned int blockSize;         // Bytes per 4x4 block
+	unsigned int levelCount;
+	const unsigned char * data;     // Points into the file data given to decodeDDS
+
+	unsigned int levelWidth(unsigned int level) const { return width >> level > 0 ? width >> level : 1; }
+	unsigned int levelHeight(unsigned int level) const { return height >> level > 0 ? height >> level : 1; }
+	size_t levelSize(unsigned int level) const { return (size_t)((levelWidth(level) + 3) / 4) * ((levelHeight(level) + 3) / 4) * blockSize; }
+};
+
+// Same as decodeBMP for DDS files. The level sizes are computed from the dimensions (not from
+// the pitch field of the header) and must all be in the file.
+bool decodeDDS(const char * path, const unsigned char * data, size_t size, DdsImage & image);
+
 //// Since GLFW 3, glfwLoadTexture2D() has been removed. You have to use another texture loading library, 
 //// or do it yourself (just like loadBMP_custom and loadDDS)
 //// Load a .TGA file using GLFW's own loader
@@ -0,0 +1,207 @@
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "mipmap.hpp"
+#include "parallel.hpp"
+#include "textureatlas.hpp"
+
+namespace {
+
+// Top of the packed area over [x, x + width)
+struct SkylineNode {
+	unsigned int x, y, width;
+};
+
+struct Bin {
+	std::vector<SkylineNode> skyline;
+};
+
+// Lowest y where a width x height rectangle can sit on the skyline starting at node, or false
+bool fitAt(const Bin & bin, size_t node, unsigned int width, unsigned int height,
+	unsigned int binWidth, unsigned int binHeight, unsigned int & y){
+	const unsigned int x = bin.skyline[node].x;
+	if (x + width > binWidth)
+		return false;
+	y = 0;
+	unsigned int covered = 0;
+	for (size_t i = node; covered < width; ++i){
+		y = std::max(y, bin.skyline[i].y);
+		covered += bin.skyline[i].width;
+	}
+	return y + height <= binHeight;
+}
+
+bool place(Bin & bin, unsigned int width, unsigned int height, unsigned int binWidth, unsigned int binHeight,
+	unsigned int & x, unsigned int & y){
+	size_t bestNode = 0;
+	unsigned int bestTop = ~0u, bestWidth = ~0u;
+	for (size_t node = 0; node < bin.skyline.size(); ++node){
+		unsigned int top;
+		if (!fitAt(bin, node, width, height, binWidth, binHeight, top))
+			continue;
+		// Lowest top first, then the narrowest node, which leaves the wide gaps for wide rectangles
+		if (top + height < bestTop || (top + height == bestTop && bin.skyline[node].width < bestWidth)){
+			bestNode = node;
+			bestTop = top + height;
+			bestWidth = bin.skyline[node].width;
+		}
+	}
+	if (bestTop == ~0u)
+		return false;
+
+	x = bin.skyline[bestNode].x;
+	y = bestTop - height;
+	SkylineNode added = { x, bestTop, width };
+	bin.skyline.insert(bin.skyline.begin() + bestNode, added);
+	// The nodes under the new one shrink or go away
+	for (size_t i = bestNode + 1; i < bin.skyline.size(); ){
+		SkylineNode & node = bin.skyline[i];
+		const unsigned int end = x + width;
+		if (node.x >= end)
+			break;
+		if (node.x + node.width <= end){
+			bin.skyline.erase(bin.skyline.begin() + i);
+			continue;
+		}
+		node.width -= end - node.x;
+		node.x = end;
+		break;
+	}
+	// Neighbours at the same height become one node
+	for (size_t i = 0; i + 1 < bin.skyline.size(); ){
+		if (bin.skyline[i].y == bin.skyline[i + 1].y){
+			bin.skyline[i].width += bin.skyline[i + 1].width;
+			bin.skyline.erase(bin.skyline.begin() + i + 1);
+		}else{
+			++i;
+		}
+	}
+	return true;
+}
+
+} // namespace
+
+bool packRectangles(const std::vector<glm::uvec2> & sizes, unsigned int binWidth, unsigned int binHeight,
+	std::vector<AtlasEntry> & placements){
+	std::vector<size_t> order(sizes.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){
+		return sizes[a].y != sizes[b].y ? sizes[a].y > sizes[b].y : sizes[a].x > sizes[b].x;
+	});
+
+	placements.resize(sizes.size());
+	std::vector<Bin> bins;
+	for (size_t k = 0; k < order.size(); ++k){
+		const glm::uvec2 & size = sizes[order[k]];
+		AtlasEntry & entry = placements[order[k]];
+		if (size.x > binWidth || size.y > binHeight)
+			return false;
+		entry.width = size.x;
+		entry.height = size.y;
+		entry.uvTransform = glm::vec4(0.0f);
+		size_t b = 0;
+		for (; b < bins.size(); ++b)
+			if (place(bins[b], size.x, size.y, binWidth, binHeight, entry.x, entry.y))
+				break;
+		if (b == bins.size()){
+			Bin bin;
+			SkylineNode floor = { 0, 0, binWidth };
+			bin.skyline.push_back(floor);
+			bins.push_back(bin);
+			place(bins.back(), size.x, size.y, binWidth, binHeight, entry.x, entry.y);
+		}
+		entry.layer = (unsigned int)b;
+	}
+	return true;
+}
+
+bool buildTextureAtlas(const std::vector<AtlasImage> & images, unsigned int size, unsigned int padding,
+	bool arrayTexture, TextureAtlas & atlas){
+	// Mipmaps down to level k only mix texels of the same image when the images start on
+	// multiples of 2^k and have at least 2^k texels of padding
+	unsigned int maxLevel = 0;
+	while ((2u << maxLevel) <= padding)
+		++maxLevel;
+	const unsigned int alignment = 1u << maxLevel;
+	if (size % alignment != 0){
+		printf("Atlas size %u is not a multiple of %u\n", size, alignment);
+		return false;
+	}
+
+	// Pack in units of alignment texels
+	std::vector<glm::uvec2> cells(images.size());
+	for (size_t i = 0; i < images.size(); ++i){
+		cells[i].x = (images[i].width + 2 * padding + alignment - 1) / alignment;
+		cells[i].y = (images[i].height + 2 * padding + alignment - 1) / alignment;
+	}
+	std::vector<AtlasEntry> entries;
+	if (!packRectangles(cells, size / alignment, size / alignment, entries)){
+		printf("An image is bigger than the atlas (%u texels with padding)\n", size);
+		return false;
+	}
+	unsigned int layerCount = 0;
+	for (size_t i = 0; i < entries.size(); ++i)
+		layerCount = std::max(layerCount, entries[i].layer + 1);
+	if (!arrayTexture && layerCount > 1){
+		printf("The images do not fit in a %ux%u atlas\n", size, size);
+		return false;
+	}
+	layerCount = std::max(layerCount, 1u);
+	for (size_t i = 0; i < entries.size(); ++i){
+		AtlasEntry & entry = entries[i];
+		entry.x = entry.x * alignment + padding;
+		entry.y = entry.y * alignment + padding;
+		entry.width = images[i].width;
+		entry.height = images[i].height;
+		entry.uvTransform = glm::vec4((float)entry.width / size, (float)entry.height / size,
+			(float)entry.x / size, (float)entry.y / size);
+	}
+
+	// Compose the layers ; the padding clamps to the nearest edge texel of the image
+	std::vector<std::vector<unsigned char> > layers(layerCount, std::vector<unsigned char>((size_t)size * size * 4, 0));
+	parallelFor(entries.size(), [&](size_t i){
+		const AtlasEntry & entry = entries[i];
+		const AtlasImage & image = images[i];
+		unsigned char * layer = &layers[entry.layer][0];
+		for (unsigned int y = entry.y - padding; y < entry.y + entry.height + padding; ++y){
+			const unsigned int sourceY = (unsigned int)std::min(std::max((int)y - (int)entry.y, 0), (int)image.height - 1);
+			for (unsigned int x = entry.x - padding; x < entry.x + entry.width + padding; ++x){
+				const unsigned int sourceX = (unsigned int)std::min(std::max((int)x - (int)entry.x, 0), (int)image.width - 1);
+				memcpy(layer + ((size_t)y * size + x) * 4, image.pixels + ((size_t)sourceY * image.width + sourceX) * 4, 4);
+			}
+		}
+	});
+
+	atlas.target = arrayTexture ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+	atlas.size = size;
+	atlas.layerCount = layerCount;
+	atlas.entries.swap(entries);
+	glGenTextures(1, &atlas.texture);
+	glBindTexture(atlas.target, atlas.texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	std::vector<MipChain> chains(layerCount);
+	for (unsigned int l = 0; l < layerCount; ++l)
+		generateMipChain(&layers[l][0], size, size, MIP_FILTER_BOX, false, chains[l]);
+	const unsigned int levelCount = std::min((unsigned int)chains[0].levelCount(), maxLevel + 1);
+	for (unsigned int level = 0; level < levelCount; ++level){
+		const GLsizei levelSize = chains[0].levelWidth(level);
+		if (arrayTexture){
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, levelSize, levelSize, layerCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+			for (unsigned int l = 0; l < layerCount; ++l)
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, l, levelSize, levelSize, 1, GL_RGBA, GL_UNSIGNED_BYTE, chains[l].level(level));
+		}else{
+			glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, levelSize, levelSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, chains[0].level(level));
+		}
+	}
+	glTexParameteri(atlas.target, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+	glTexParameteri(atlas.target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(atlas.target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(atlas.target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(atlas.target, GL_TEXTURE_MIN_FILTER, levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	return true;
+}
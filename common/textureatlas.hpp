@@ -0,0 +1,47 @@
+#ifndef TEXTUREATLAS_HPP
+#define TEXTUREATLAS_HPP
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Packs many small textures into a few big ones, so that objects with different textures can
+// be drawn without binding a texture in between.
+
+// Place of a rectangle in a bin (or of an image in an atlas)
+struct AtlasEntry {
+	unsigned int layer;           // Bin, or layer of a GL_TEXTURE_2D_ARRAY
+	unsigned int x, y;            // Corner of the image, inside its padding
+	unsigned int width, height;
+	glm::vec4 uvTransform;        // uv in the atlas = uv * uvTransform.xy + uvTransform.zw
+};
+
+// Skyline packing, tallest rectangles first : every rectangle goes where its top ends lowest.
+// Opens a new bin whenever a rectangle fits in none of the previous ones. Returns false if a
+// rectangle is bigger than a bin. placements[i] is for sizes[i] (uvTransform left unset).
+bool packRectangles(const std::vector<glm::uvec2> & sizes, unsigned int binWidth, unsigned int binHeight,
+	std::vector<AtlasEntry> & placements);
+
+// An RGBA image, rows tightly packed
+struct AtlasImage {
+	unsigned int width, height;
+	const unsigned char * pixels;
+};
+
+struct TextureAtlas {
+	GLuint texture;
+	GLenum target;                      // GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY
+	unsigned int size, layerCount;      // size x size texels per layer
+	std::vector<AtlasEntry> entries;    // One per image
+};
+
+// Builds a size x size atlas texture, or a GL_TEXTURE_2D_ARRAY with as many layers as needed
+// when arrayTexture is set (a plain atlas fails if the images do not fit in one). Each image is
+// surrounded by padding texels repeating its edges and placed on a multiple of 2^k, k =
+// log2(padding), and the mipmaps stop at level k : the lower levels would mix neighbours. The
+// entries cannot use GL_REPEAT wrapping, except when every image fills a layer of its own.
+bool buildTextureAtlas(const std::vector<AtlasImage> & images, unsigned int size, unsigned int padding,
+	bool arrayTexture, TextureAtlas & atlas);
+
+#endif
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <GL/glew.h>
+
+#include "mappedfile.hpp"
+#include "texture.hpp"
+#include "textureloader.hpp"
+
+TextureLoader::TextureLoader(unsigned int threadCount, size_t inSlotBytes, unsigned int ringSize)
+	: queue(threadCount, &TextureLoader::decode), pendingCount(0), slotBytes(inSlotBytes), nextSlot(0)
+{
+	StagingSlot empty = { 0, 0, 0 };
+	ring.assign(ringSize > 0 ? ringSize : 1, empty);
+}
+
+TextureLoader::~TextureLoader(){
+}
+
+void TextureLoader::setMipCacheDirectory(const char * directory){
+	mipCacheDirectory = directory != NULL ? directory : "";
+}
+
+size_t TextureLoader::requestBMP(const char * imagePath){
+	TextureRecord * record = new TextureRecord();
+	record->path = imagePath;
+	if (!mipCacheDirectory.empty()){
+		// Named after the image path ; the file itself checks the pixels (see loadMipChain)
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.mips", (unsigned long long)hashBytes(imagePath, strlen(imagePath)));
+		record->mipCachePath = mipCacheDirectory + "/" + name;
+	}
+	record->loaded = false;
+	record->next = NULL;
+	record->state = TEXTURE_LOADING;
+	record->texture = 0;
+	record->uploadLevel = 0;
+	record->uploadedRows = 0;
+	records.push_back(std::unique_ptr<TextureRecord>(record));
+	++pendingCount;
+	queue.push(record);
+	return records.size() - 1;
+}
+
+void TextureLoader::decode(TextureRecord & record){
+	MappedFile file;
+	BmpImage image;
+	if (!file.open(record.path.c_str())){
+		printf("%s could not be opened. Are you in the right directory ?\n", record.path.c_str());
+		return;
+	}
+	if (!decodeBMP(record.path.c_str(), (const unsigned char *)file.data(), file.size(), image))
+		return;
+
+	// BGR to BGRA : 4-byte texels upload without conversion on most drivers, and the rows lose
+	// their padding. The file pages are only touched here, never on the render thread.
+	std::vector<unsigned char> pixels((size_t)image.width * image.height * 4);
+	expandBMPPixels(image, false, &pixels[0]);
+	// Box filtered in gamma space, which is what glGenerateMipmap did for loadBMP_custom
+	if (record.mipCachePath.empty())
+		generateMipChain(&pixels[0], image.width, image.height, MIP_FILTER_BOX, false, record.mips);
+	else
+		loadOrGenerateMipChain(record.mipCachePath.c_str(), &pixels[0], image.width, image.height,
+			MIP_FILTER_BOX, false, record.mips);
+	record.loaded = true;
+}
+
+TextureLoader::StagingSlot * TextureLoader::acquireSlot(){
+	StagingSlot & slot = ring[nextSlot];
+	if (slot.buffer == 0)
+		glGenBuffers(1, &slot.buffer);
+	if (slot.fence != 0){
+		// Poll, never wait : a busy slot means the copies are behind, try again next call
+		GLenum status = glClientWaitSync(slot.fence, 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED)
+			return NULL;
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+	}
+	nextSlot = (nextSlot + 1) % ring.size();
+	return &slot;
+}
+
+bool TextureLoader::uploadSome(TextureRecord & record, size_t & byteBudget){
+	const MipChain & mips = record.mips;
+	if (record.state == TEXTURE_LOADING){
+		// First call for this texture : allocate every level, they are filled band by band below
+		record.state = TEXTURE_UPLOADING;
+		glGenTextures(1, &record.texture);
+		glBindTexture(GL_TEXTURE_2D, record.texture);
+		for (size_t level = 0; level < mips.levelCount(); ++level)
+			glTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_RGBA8, mips.levelWidth(level), mips.levelHeight(level), 0,
+				GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, NULL);
+	}
+	glBindTexture(GL_TEXTURE_2D, record.texture);
+	while (byteBudget > 0 && record.uploadLevel < mips.levelCount()){
+		const unsigned int width = mips.levelWidth(record.uploadLevel), height = mips.levelHeight(record.uploadLevel);
+		const size_t rowBytes = (size_t)width * 4;
+		StagingSlot * slot = acquireSlot();
+		if (slot == NULL){
+			byteBudget = 0;
+			break;
+		}
+		// At least one row per band, so a small budget still makes progress
+		size_t rows = height - record.uploadedRows;
+		size_t fit = (slotBytes > rowBytes ? slotBytes : rowBytes) / rowBytes;
+		if (rows > fit) rows = fit;
+		if (rows * rowBytes > byteBudget) rows = byteBudget / rowBytes > 0 ? byteBudget / rowBytes : 1;
+		const size_t bytes = rows * rowBytes;
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->buffer);
+		if (slot->capacity < bytes){
+			slot->capacity = bytes > slotBytes ? bytes : slotBytes;
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, slot->capacity, NULL, GL_STREAM_DRAW);
+		}
+		// The fence said the GPU is done with this buffer, so there is nothing to synchronize
+		void * mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (mapped != NULL){
+			memcpy(mapped, mips.level(record.uploadLevel) + (size_t)record.uploadedRows * rowBytes, bytes);
+			if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)){
+				glTexSubImage2D(GL_TEXTURE_2D, (GLint)record.uploadLevel, 0, record.uploadedRows, width, (GLsizei)rows,
+					GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, (void*)0);
+				slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+				record.uploadedRows += (unsigned int)rows;
+				if (record.uploadedRows == height){
+					++record.uploadLevel;
+					record.uploadedRows = 0;
+				}
+			}
+			// else the buffer contents were lost (display mode change...) : upload the band again
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		byteBudget -= bytes < byteBudget ? bytes : byteBudget;
+	}
+	if (record.uploadLevel < mips.levelCount())
+		return false;
+
+	// Nice trilinear filtering, like loadBMP_custom
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)mips.levelCount() - 1);
+	return true;
+}
+
+size_t TextureLoader::uploadPending(size_t byteBudget){
+	queue.takeCompleted(uploads);
+
+	size_t residentCount = 0;
+	while (!uploads.empty()){
+		TextureRecord & record = *uploads.front();
+		if (!record.loaded){
+			printf("Could not load %s\n", record.path.c_str());
+			record.state = TEXTURE_FAILED;
+		}else if (byteBudget == 0 || !uploadSome(record, byteBudget)){
+			break;
+		}else{
+			record.state = TEXTURE_RESIDENT;
+			std::vector<unsigned char>().swap(record.mips.data);
+			++residentCount;
+		}
+		--pendingCount;
+		uploads.pop_front();
+	}
+	return residentCount;
+}
+
+bool TextureLoader::isResident(size_t handle) const {
+	return records[handle]->state == TEXTURE_RESIDENT;
+}
+
+bool TextureLoader::hasFailed(size_t handle) const {
+	return records[handle]->state == TEXTURE_FAILED;
+}
+
+bool TextureLoader::isIdle() const {
+	return pendingCount == 0;
+}
+
+GLuint TextureLoader::texture(size_t handle) const {
+	return records[handle]->texture;
+}
+
+void TextureLoader::releaseTextures(){
+	for (size_t i = 0; i < records.size(); ++i){
+		if (records[i]->texture != 0) glDeleteTextures(1, &records[i]->texture);
+		records[i]->texture = 0;
+	}
+	for (size_t s = 0; s < ring.size(); ++s){
+		if (ring[s].fence != 0) glDeleteSync(ring[s].fence);
+		if (ring[s].buffer != 0) glDeleteBuffers(1, &ring[s].buffer);
+		ring[s].fence = 0;
+		ring[s].buffer = 0;
+		ring[s].capacity = 0;
+	}
+}
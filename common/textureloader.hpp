@@ -0,0 +1,99 @@
+#ifndef TEXTURELOADER_HPP
+#define TEXTURELOADER_HPP
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "mipmap.hpp"
+#include "workqueue.hpp"
+
+// Loads BMP textures in the background and streams them to GL from the render thread, the way
+// AssetLoader does for meshes. Workers map each file and decode it to BGRA (GL's fast upload
+// format) ; uploadPending() then copies at most a given number of bytes per call into a ring of
+// pixel unpack buffers and lets glTexSubImage2D read from them, so the driver copies to the
+// texture asynchronously. A fence per ring slot tells when it can be reused ; a slot still in
+// use ends the call instead of waiting. Big textures are uploaded as bands of rows across
+// several calls. The mipmaps are built by the workers too (box filter, optionally cached, see
+// setMipCacheDirectory) and streamed level after level like level 0. Needs GL 3.2 (fences).
+class TextureLoader {
+public:
+	// threadCount 0 : workerThreadCount(). The ring has ringSize buffers of slotBytes bytes
+	// (grown if a single row is bigger).
+	explicit TextureLoader(unsigned int threadCount = 0, size_t slotBytes = 1 << 20, unsigned int ringSize = 3);
+	// Drops the requests not started yet and waits for the workers. Does not touch GL : call
+	// releaseTextures() while the context is still current.
+	~TextureLoader();
+
+	// Keeps the generated mipmaps as files in directory (one per image path, see saveMipChain) and
+	// reads them back on the next run. Affects the requests made afterwards ; NULL or "" turns the
+	// cache off (the default), so nothing is written next to the assets.
+	void setMipCacheDirectory(const char * directory);
+
+	// Queues a 24 bits BMP file and returns its handle. Does not need a GL context.
+	size_t requestBMP(const char * imagePath);
+
+	// Needs the GL context. Uploads decoded textures in completion order, stopping once
+	// byteBudget bytes were sent or the ring is busy. Returns the number of textures that
+	// became resident.
+	size_t uploadPending(size_t byteBudget);
+
+	bool isResident(size_t handle) const;
+	// True once loading the texture failed (missing file, unsupported BMP...)
+	bool hasFailed(size_t handle) const;
+	// True when every request is either resident or failed
+	bool isIdle() const;
+	// Valid once isResident(handle) ; trilinear filtering, repeat wrapping, like loadBMP_custom
+	GLuint texture(size_t handle) const;
+
+	// Deletes every texture and the ring buffers. Needs the GL context.
+	void releaseTextures();
+
+private:
+	TextureLoader(const TextureLoader &);
+	TextureLoader & operator=(const TextureLoader &);
+
+	enum TextureState { TEXTURE_LOADING, TEXTURE_UPLOADING, TEXTURE_RESIDENT, TEXTURE_FAILED };
+
+	struct TextureRecord {
+		std::string path;
+		std::string mipCachePath;            // Empty : no cache
+		MipChain mips;                       // BGRA, bottom row first ; written by a worker
+		bool loaded;                         // Worker result, valid once the record is published
+		TextureRecord * next;                // Link in the completion list
+		// Render thread only
+		TextureState state;
+		GLuint texture;
+		size_t uploadLevel;
+		unsigned int uploadedRows;           // Of uploadLevel
+	};
+
+	struct StagingSlot {
+		GLuint buffer;
+		size_t capacity;
+		GLsync fence;   // Set while glTexSubImage2D may still read the buffer
+	};
+
+	static void decode(TextureRecord & record);
+	bool uploadSome(TextureRecord & record, size_t & byteBudget);
+	// Next ring slot if the GPU is done with it, NULL if not
+	StagingSlot * acquireSlot();
+
+	std::vector<std::unique_ptr<TextureRecord> > records;
+	std::string mipCacheDirectory;
+	// After records : its workers are joined before the records go away
+	WorkQueue<TextureRecord> queue;
+	// Decoded textures waiting for upload, oldest first
+	std::deque<TextureRecord *> uploads;
+	size_t pendingCount;
+
+	// Created on the first upload, once there is a context
+	std::vector<StagingSlot> ring;
+	size_t slotBytes;
+	size_t nextSlot;
+};
+
+#endif
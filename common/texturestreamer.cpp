@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "texture.hpp"
+#include "texturestreamer.hpp"
+
+namespace {
+
+// Levels this size and below are uploaded with the texture and never evicted : they are small,
+// and a texture always needs something to sample
+const unsigned int MIP_TAIL_SIZE = 64;
+
+} // namespace
+
+TextureStreamer::TextureStreamer(size_t budgetBytes)
+	: budget(budgetBytes), residentTotal(0), tailTotal(0), frame(1)
+{
+}
+
+TextureStreamer::~TextureStreamer(){
+}
+
+size_t TextureStreamer::addDDS(const char * path){
+	std::unique_ptr<StreamedTexture> texture(new StreamedTexture());
+	texture->file.reset(new MappedFile());
+	if (!texture->file->open(path)){
+		printf("%s could not be opened. Are you in the right directory ?\n", path);
+		return INVALID_TEXTURE;
+	}
+	DdsImage image;
+	if (!decodeDDS(path, (const unsigned char *)texture->file->data(), texture->file->size(), image))
+		return INVALID_TEXTURE;
+	// Levels missing at the end of the chain cannot be streamed : the tail must go down to 1x1
+	if (std::max(image.levelWidth(image.levelCount - 1), image.levelHeight(image.levelCount - 1)) > MIP_TAIL_SIZE){
+		printf("%s: not enough mipmaps to stream\n", path);
+		return INVALID_TEXTURE;
+	}
+	texture->width = image.width;
+	texture->height = image.height;
+	texture->format = image.format;
+	texture->compressed = true;
+	const unsigned char * level = image.data;
+	for (unsigned int l = 0; l < image.levelCount; ++l){
+		texture->levels.push_back(level);
+		texture->levelBytes.push_back(image.levelSize(l));
+		level += image.levelSize(l);
+	}
+	return addTexture(texture.release());
+}
+
+size_t TextureStreamer::addMipChain(MipChain & chain, GLenum format){
+	StreamedTexture * texture = new StreamedTexture();
+	texture->width = chain.width;
+	texture->height = chain.height;
+	texture->format = format;
+	texture->compressed = false;
+	texture->pixels.swap(chain.data);
+	for (size_t l = 0; l < chain.levelCount(); ++l){
+		texture->levels.push_back(&texture->pixels[chain.levelOffsets[l]]);
+		texture->levelBytes.push_back(chain.levelOffsets[l + 1] - chain.levelOffsets[l]);
+	}
+	chain.levelOffsets.clear();
+	return addTexture(texture);
+}
+
+size_t TextureStreamer::addTexture(StreamedTexture * texture){
+	textures.push_back(std::unique_ptr<StreamedTexture>(texture));
+	const unsigned int levelCount = (unsigned int)texture->levels.size();
+	texture->tailLevel = 0;
+	while (std::max(texture->width >> texture->tailLevel, texture->height >> texture->tailLevel) > MIP_TAIL_SIZE)
+		++texture->tailLevel;
+	texture->residentLevel = levelCount;
+	texture->wantedLevel = texture->tailLevel;
+	texture->lastRequest = 0;
+
+	glGenTextures(1, &texture->texture);
+	glBindTexture(GL_TEXTURE_2D, texture->texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+	// Coarsest first, so the texture is complete as soon as the tail is in
+	for (unsigned int level = levelCount; level-- > texture->tailLevel; ){
+		uploadLevel(*texture, level);
+		tailTotal += texture->levelBytes[level];
+	}
+	return textures.size() - 1;
+}
+
+void TextureStreamer::uploadLevel(StreamedTexture & texture, unsigned int level){
+	const GLsizei width = std::max(texture.width >> level, 1u), height = std::max(texture.height >> level, 1u);
+	glBindTexture(GL_TEXTURE_2D, texture.texture);
+	if (texture.compressed){
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, texture.format, width, height, 0,
+			(GLsizei)texture.levelBytes[level], texture.levels[level]);
+	}else{
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, width, height, 0, texture.format, GL_UNSIGNED_BYTE, texture.levels[level]);
+	}
+	// The new level is complete, only now can sampling start from it
+	texture.residentLevel = level;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+	residentTotal += texture.levelBytes[level];
+}
+
+bool TextureStreamer::evictOne(const StreamedTexture * loading){
+	// First the levels finer than wanted, then the least recently requested textures ; never the
+	// levels a texture requested this frame still needs, nor the tails
+	StreamedTexture * victim = NULL;
+	bool victimUnneeded = false;
+	for (size_t i = 0; i < textures.size(); ++i){
+		StreamedTexture * texture = textures[i].get();
+		if (texture == loading || texture->residentLevel >= texture->tailLevel)
+			continue;
+		const bool unneeded = texture->residentLevel < texture->wantedLevel;
+		if (texture->lastRequest == frame && !unneeded)
+			continue;
+		if (victim == NULL || (unneeded && !victimUnneeded) ||
+			(unneeded == victimUnneeded && texture->lastRequest < victim->lastRequest)){
+			victim = texture;
+			victimUnneeded = unneeded;
+		}
+	}
+	if (victim == NULL)
+		return false;
+
+	const unsigned int level = victim->residentLevel;
+	glBindTexture(GL_TEXTURE_2D, victim->texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+	// Outside [base, max] the level does not count for completeness ; 0x0 releases its storage
+	glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	victim->residentLevel = level + 1;
+	residentTotal -= victim->levelBytes[level];
+	return true;
+}
+
+void TextureStreamer::request(size_t handle, float screenSize){
+	StreamedTexture & texture = *textures[handle];
+	// Level l has max(width, height) >> l texels across : the finest one with at least one texel
+	// per pixel
+	const float texels = (float)std::max(texture.width, texture.height);
+	if (!(screenSize >= 0.0f))
+		screenSize = 0.0f;   // NaN or negative : not visible, the tail is enough
+	int level = screenSize >= texels ? 0 : (int)floorf(log2f(texels / std::max(screenSize, 1e-6f)));
+	unsigned int wanted = (unsigned int)std::min(level, (int)texture.tailLevel);
+	if (texture.lastRequest != frame || wanted < texture.wantedLevel)
+		texture.wantedLevel = wanted;
+	texture.lastRequest = frame;
+}
+
+size_t TextureStreamer::update(size_t uploadBudget){
+	size_t uploaded = 0;
+	for (;;){
+		// Smallest missing level over the textures requested this frame
+		StreamedTexture * next = NULL;
+		for (size_t i = 0; i < textures.size(); ++i){
+			StreamedTexture * texture = textures[i].get();
+			if (texture->lastRequest != frame || texture->residentLevel <= texture->wantedLevel)
+				continue;
+			if (next == NULL || texture->levelBytes[texture->residentLevel - 1] < next->levelBytes[next->residentLevel - 1])
+				next = texture;
+		}
+		if (next == NULL)
+			break;
+		const size_t bytes = next->levelBytes[next->residentLevel - 1];
+		if (uploaded > 0 && uploaded + bytes > uploadBudget)
+			break;
+		bool fits = true;
+		while (fits && residentTotal + bytes > budget)
+			fits = evictOne(next);
+		if (!fits)
+			break;   // The budget is full of levels in use, nothing smaller will come next
+		uploadLevel(*next, next->residentLevel - 1);
+		uploaded += bytes;
+	}
+	++frame;
+	return uploaded;
+}
+
+GLuint TextureStreamer::texture(size_t handle) const {
+	return textures[handle]->texture;
+}
+
+unsigned int TextureStreamer::residentLevel(size_t handle) const {
+	return textures[handle]->residentLevel;
+}
+
+unsigned int TextureStreamer::wantedLevel(size_t handle) const {
+	return textures[handle]->wantedLevel;
+}
+
+void TextureStreamer::releaseTextures(){
+	for (size_t i = 0; i < textures.size(); ++i){
+		if (textures[i]->texture != 0) glDeleteTextures(1, &textures[i]->texture);
+		textures[i]->texture = 0;
+	}
+	residentTotal = tailTotal = 0;
+}
+
+float TextureStreamer::screenSize(float worldSize, float distance, const glm::mat4 & Projection, float viewportHeight){
+	// Projection[1][1] is 1 / tan(fovY / 2), see selectLod
+	return worldSize * Projection[1][1] * viewportHeight * 0.5f / std::max(distance, 1e-6f);
+}
@@ -0,0 +1,93 @@
+#ifndef TEXTURESTREAMER_HPP
+#define TEXTURESTREAMER_HPP
+
+#include <memory>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "mappedfile.hpp"
+#include "mipmap.hpp"
+
+// Keeps only the mip levels that are visible on screen, under a memory budget. Each texture
+// starts with its mip tail (the levels of 64x64 and below), which is always resident ; finer
+// levels are uploaded one at a time when request() asks for them, smallest levels first over
+// all textures, and dropped again when the budget is full, finest level of the least recently
+// requested texture first. The resident levels of a texture are its finest resident level down
+// to 1x1 : GL_TEXTURE_BASE_LEVEL points at the finest one, and evicted levels are redefined as
+// 0x0 so the driver can free them.
+// DDS textures are read straight from a mapping of the file, so the levels that are never
+// requested are never read either. Needs the GL context for everything except request().
+class TextureStreamer {
+public:
+	static const size_t INVALID_TEXTURE = (size_t)-1;
+
+	// budgetBytes : GPU memory allowed for all resident levels, tails included. The tails are never
+	// evicted, so the finer levels get what the tails leave (nothing if they fill the budget).
+	explicit TextureStreamer(size_t budgetBytes);
+	// Does not touch GL : call releaseTextures() while the context is still current
+	~TextureStreamer();
+
+	// Maps a DXT1/3/5 DDS file and uploads its tail. Returns INVALID_TEXTURE if the file cannot be used.
+	size_t addDDS(const char * path);
+	// Takes the data of chain (left empty) ; format is GL_RGBA or GL_BGRA
+	size_t addMipChain(MipChain & chain, GLenum format);
+
+	// The texture is drawn this frame, and its whole [0, 1] UV range covers about screenSize
+	// pixels across (see screenSize()). Several requests in a frame keep the largest.
+	void request(size_t handle, float screenSize);
+
+	// Streams the requested levels, at most uploadBudget bytes (but always at least one level),
+	// then starts a new frame. Returns the number of bytes uploaded.
+	size_t update(size_t uploadBudget);
+
+	GLuint texture(size_t handle) const;
+	// Finest level currently resident (0 is the full resolution)
+	unsigned int residentLevel(size_t handle) const;
+	// Finest level wanted by the last requests
+	unsigned int wantedLevel(size_t handle) const;
+	size_t residentBytes() const { return residentTotal; }
+	// Part of residentBytes() taken by the tails
+	size_t tailBytes() const { return tailTotal; }
+	size_t budgetBytes() const { return budget; }
+	void setBudgetBytes(size_t budgetBytes) { budget = budgetBytes; }
+
+	// Deletes every texture. Needs the GL context.
+	void releaseTextures();
+
+	// Pixels covered by a length of worldSize at distance from the camera
+	static float screenSize(float worldSize, float distance, const glm::mat4 & Projection, float viewportHeight);
+
+private:
+	TextureStreamer(const TextureStreamer &);
+	TextureStreamer & operator=(const TextureStreamer &);
+
+	struct StreamedTexture {
+		std::unique_ptr<MappedFile> file;            // DDS source
+		std::vector<unsigned char> pixels;           // MipChain source
+		std::vector<const unsigned char *> levels;   // Source data of every level
+		std::vector<size_t> levelBytes;
+		unsigned int width, height;
+		GLenum format;                               // Compressed internal format, or pixel format
+		bool compressed;
+		GLuint texture;
+		unsigned int residentLevel;                  // Finest resident level
+		unsigned int tailLevel;                      // First level of the tail
+		unsigned int wantedLevel;
+		unsigned long lastRequest;                   // Frame of the last request()
+	};
+
+	size_t addTexture(StreamedTexture * texture);
+	void uploadLevel(StreamedTexture & texture, unsigned int level);
+	// Drops the finest resident level of one texture that can spare it. False if none can.
+	bool evictOne(const StreamedTexture * loading);
+
+	std::vector<std::unique_ptr<StreamedTexture> > textures;
+	size_t budget;
+	size_t residentTotal;   // Every resident level, tails included
+	size_t tailTotal;
+	unsigned long frame;
+};
+
+#endif
@@ -1,9 +1,13 @@
 #include <vector>
-#include <map>
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
 
 #include <glm/glm.hpp>
 
 #include "vboindexer.hpp"
+#include "hashtable.hpp"
+#include "parallel.hpp"
 
 #include <string.h> // for memcmp
 
@@ -13,88 +17,182 @@ bool is_near(float v1, float v2){
 	return fabs( v1-v2 ) < 0.01f;
 }
 
-// Searches through all already-exported vertices
-// for a similar one.
-// Similar = same position + same UVs + same normal
-bool getSimilarVertexIndex( 
-	glm::vec3 & in_vertex, 
-	glm::vec2 & in_uv, 
-	glm::vec3 & in_normal, 
-	std::vector<glm::vec3> & out_vertices,
-	std::vector<glm::vec2> & out_uvs,
-	std::vector<glm::vec3> & out_normals,
-	unsigned short & result
+// Similar = same position + same UVs + same normal, each component within is_near's tolerance
+static bool isSimilarVertex(
+	const glm::vec3 & in_vertex,
+	const glm::vec2 & in_uv,
+	const glm::vec3 & in_normal,
+	const glm::vec3 & vertex,
+	const glm::vec2 & uv,
+	const glm::vec3 & normal
 ){
-	// Lame linear search
-	for ( unsigned int i=0; i<out_vertices.size(); i++ ){
-		if (
-			is_near( in_vertex.x , out_vertices[i].x ) &&
-			is_near( in_vertex.y , out_vertices[i].y ) &&
-			is_near( in_vertex.z , out_vertices[i].z ) &&
-			is_near( in_uv.x     , out_uvs     [i].x ) &&
-			is_near( in_uv.y     , out_uvs     [i].y ) &&
-			is_near( in_normal.x , out_normals [i].x ) &&
-			is_near( in_normal.y , out_normals [i].y ) &&
-			is_near( in_normal.z , out_normals [i].z )
-		){
-			result = i;
-			return true;
+	return
+		is_near( in_vertex.x , vertex.x ) &&
+		is_near( in_vertex.y , vertex.y ) &&
+		is_near( in_vertex.z , vertex.z ) &&
+		is_near( in_uv.x     , uv.x ) &&
+		is_near( in_uv.y     , uv.y ) &&
+		is_near( in_normal.x , normal.x ) &&
+		is_near( in_normal.y , normal.y ) &&
+		is_near( in_normal.z , normal.z );
+}
+
+// Finds already-exported vertices similar to a new one without scanning all of them.
+// Exported vertices are bucketed by position into a grid, and a lookup only visits the cells that
+// overlap the box of positions within is_near's tolerance of the new vertex. Among the similar
+// vertices found there, the lowest index wins, as with a linear search.
+class SimilarVertexGrid {
+public:
+	explicit SimilarVertexGrid(size_t expectedVertices) : cellTable(expectedVertices) { }
+
+	bool find(
+		const glm::vec3 & in_vertex,
+		const glm::vec2 & in_uv,
+		const glm::vec3 & in_normal,
+		const std::vector<glm::vec3> & out_vertices,
+		const std::vector<glm::vec2> & out_uvs,
+		const std::vector<glm::vec3> & out_normals,
+		unsigned int & result
+	) const {
+		// Cells overlapped by the box of positions within tolerance of in_vertex
+		Cell low, high;
+		if (!cellOf(in_vertex, -TOLERANCE, low) || !cellOf(in_vertex, TOLERANCE, high))
+			return false;
+		bool found = false;
+		for (long long z = low.z; z <= high.z; ++z) for (long long y = low.y; y <= high.y; ++y) for (long long x = low.x; x <= high.x; ++x){
+			Cell cell = { x, y, z };
+			uint32_t id = cellTable.find(hashCell(cell), [&](uint32_t candidate){ return cells[candidate] == cell; });
+			if (id == IdHashTable::NOT_FOUND)
+				continue;
+			for (uint32_t i = cellFirst[id]; i != IdHashTable::NOT_FOUND; i = nextInCell[i]){
+				if ((!found || i < result) &&
+					isSimilarVertex(in_vertex, in_uv, in_normal, out_vertices[i], out_uvs[i], out_normals[i])){
+					result = i;
+					found = true;
+				}
+			}
 		}
+		return found;
 	}
-	// No other vertex could be used instead.
-	// Looks like we'll have to add it to the VBO.
-	return false;
-}
+
+	// Adds the vertex exported at index (indices must come in increasing order)
+	void insert(const glm::vec3 & vertex, unsigned int index){
+		if (nextInCell.size() <= index)
+			nextInCell.resize(index + 1, IdHashTable::NOT_FOUND);
+		Cell cell;
+		if (!cellOf(vertex, 0.0, cell))
+			return; // NaN or infinite : never similar to anything
+		uint32_t newId = (uint32_t)cells.size();
+		uint32_t id = cellTable.findOrInsert(hashCell(cell), newId, [&](uint32_t candidate){ return cells[candidate] == cell; });
+		if (id == newId){
+			cells.push_back(cell);
+			cellFirst.push_back(IdHashTable::NOT_FOUND);
+		}
+		nextInCell[index] = cellFirst[id];
+		cellFirst[id] = index;
+	}
+
+private:
+	struct Cell {
+		long long x, y, z;
+		bool operator==(const Cell & that) const { return x == that.x && y == that.y && z == that.z; }
+	};
+
+	// is_near's tolerance, plus a margin that covers float rounding
+	static constexpr double TOLERANCE = 0.0101;
+	// With cells 4 times the tolerance, a lookup probes 1 to 8 cells, 3.4 on average
+	static constexpr double CELL_SIZE = 4 * TOLERANCE;
+
+	// Cell of v + offset on every axis
+	static bool cellOf(const glm::vec3 & v, double offset, Cell & cell){
+		static const double LIMIT = 1e15;
+		double x = floor((v.x + offset) / CELL_SIZE), y = floor((v.y + offset) / CELL_SIZE), z = floor((v.z + offset) / CELL_SIZE);
+		if (!(fabs(x) < LIMIT && fabs(y) < LIMIT && fabs(z) < LIMIT))
+			return false;
+		cell.x = (long long)x;
+		cell.y = (long long)y;
+		cell.z = (long long)z;
+		return true;
+	}
+
+	static uint64_t hashCell(const Cell & cell){
+		uint32_t words[6];
+		memcpy(words, &cell, sizeof(words));
+		return IdHashTable::hashWords(words, 6);
+	}
+
+	IdHashTable cellTable;
+	std::vector<Cell> cells;
+	std::vector<uint32_t> cellFirst;   // Last vertex inserted in each cell
+	std::vector<uint32_t> nextInCell;  // Previous vertex of the same cell, per exported vertex
+};
 
 void indexVBO_slow(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
 
-	std::vector<unsigned short> & out_indices,
+	IndexBuffer & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals
 ){
+	SimilarVertexGrid grid(in_vertices.size() / 4);
+	for ( size_t i=0; i<out_vertices.size(); i++ )
+		grid.insert(out_vertices[i], (unsigned int)i);
+	std::vector<unsigned int> indices(in_vertices.size());
+
 	// For each input vertex
-	for ( unsigned int i=0; i<in_vertices.size(); i++ ){
+	for ( size_t i=0; i<in_vertices.size(); i++ ){
 
 		// Try to find a similar vertex in out_XXXX
-		unsigned short index;
-		bool found = getSimilarVertexIndex(in_vertices[i], in_uvs[i], in_normals[i],     out_vertices, out_uvs, out_normals, index);
+		unsigned int index;
+		bool found = grid.find(in_vertices[i], in_uvs[i], in_normals[i],     out_vertices, out_uvs, out_normals, index);
 
 		if ( found ){ // A similar vertex is already in the VBO, use it instead !
-			out_indices.push_back( index );
+			indices[i] = index;
 		}else{ // If not, it needs to be added in the output data.
 			out_vertices.push_back( in_vertices[i]);
 			out_uvs     .push_back( in_uvs[i]);
 			out_normals .push_back( in_normals[i]);
-			out_indices .push_back( (unsigned short)out_vertices.size() - 1 );
+			indices[i] = (unsigned int)out_vertices.size() - 1;
+			grid.insert(in_vertices[i], indices[i]);
 		}
 	}
+	out_indices.assign(indices, out_vertices.size());
+}
+
+void IndexBuffer::assign(const std::vector<unsigned int> & indices, size_t vertexCount){
+	clear();
+	wide = vertexCount > 65536;
+	if (wide){
+		indices32 = indices;
+	}else{
+		indices16.resize(indices.size());
+		for (size_t i = 0; i < indices.size(); ++i)
+			indices16[i] = (unsigned short)indices[i];
+	}
+}
+
+void IndexBuffer::clear(){
+	wide = false;
+	std::vector<unsigned short>().swap(indices16);
+	std::vector<unsigned int>().swap(indices32);
 }
 
+// Position, uv and normal of one vertex, compared and hashed bit by bit
 struct PackedVertex{
 	glm::vec3 position;
 	glm::vec2 uv;
 	glm::vec3 normal;
-	bool operator<(const PackedVertex that) const{
-		return memcmp((void*)this, (void*)&that, sizeof(PackedVertex))>0;
-	};
 };
 
-bool getSimilarVertexIndex_fast( 
-	PackedVertex & packed, 
-	std::map<PackedVertex,unsigned short> & VertexToOutIndex,
-	unsigned short & result
-){
-	std::map<PackedVertex,unsigned short>::iterator it = VertexToOutIndex.find(packed);
-	if ( it == VertexToOutIndex.end() ){
-		return false;
-	}else{
-		result = it->second;
-		return true;
-	}
+static_assert(sizeof(PackedVertex) == 8 * sizeof(uint32_t), "PackedVertex must be tightly packed");
+
+static uint64_t hashPackedVertex(const PackedVertex & packed){
+	uint32_t words[8];
+	memcpy(words, &packed, sizeof(words));
+	return IdHashTable::hashWords(words, 8);
 }
 
 void indexVBO(
@@ -102,41 +200,150 @@ void indexVBO(
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
 
-	std::vector<unsigned short> & out_indices,
+	IndexBuffer & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals
 ){
-	std::map<PackedVertex,unsigned short> VertexToOutIndex;
+	// Reserved in bulk : closed meshes share each vertex between about 6 corners, so a quarter of
+	// the corners covers nearly every mesh without rehashing and keeps the table cache-friendly.
+	// The table stores output indices relative to base ; the keys are the output vertices themselves.
+	IdHashTable VertexToOutIndex(in_vertices.size() / 4);
+	const size_t base = out_vertices.size();
+	std::vector<unsigned int> indices(in_vertices.size());
 
 	// For each input vertex
-	for ( unsigned int i=0; i<in_vertices.size(); i++ ){
+	for ( size_t i=0; i<in_vertices.size(); i++ ){
 
 		PackedVertex packed = {in_vertices[i], in_uvs[i], in_normals[i]};
-		
-
-		// Try to find a similar vertex in out_XXXX
-		unsigned short index;
-		bool found = getSimilarVertexIndex_fast( packed, VertexToOutIndex, index);
 
-		if ( found ){ // A similar vertex is already in the VBO, use it instead !
-			out_indices.push_back( index );
-		}else{ // If not, it needs to be added in the output data.
+		// Try to find an identical vertex among the ones already output, or add this one
+		unsigned int newindex = (unsigned int)(out_vertices.size() - base);
+		unsigned int index = VertexToOutIndex.findOrInsert(hashPackedVertex(packed), newindex, [&](uint32_t candidate){
+			return memcmp(&out_vertices[base + candidate], &packed.position, sizeof(glm::vec3)) == 0 &&
+				memcmp(&out_uvs[base + candidate], &packed.uv, sizeof(glm::vec2)) == 0 &&
+				memcmp(&out_normals[base + candidate], &packed.normal, sizeof(glm::vec3)) == 0;
+		});
+		if ( index == newindex ){ // Not seen yet : it needs to be added in the output data.
 			out_vertices.push_back( in_vertices[i]);
 			out_uvs     .push_back( in_uvs[i]);
 			out_normals .push_back( in_normals[i]);
-			unsigned short newindex = (unsigned short)out_vertices.size() - 1;
-			out_indices .push_back( newindex );
-			VertexToOutIndex[ packed ] = newindex;
 		}
+		indices[i] = (unsigned int)base + index;
 	}
+	out_indices.assign(indices, out_vertices.size());
 }
 
+// Same result as indexVBO, computed in parallel :
+// 1. hash every corner and partition the corners into buckets by hash, keeping their order
+// 2. dedupe every bucket on its own, concurrently : identical corners always share a bucket, and
+//    the first corner of each group of identical ones becomes its representative
+// 3. a prefix sum over the representatives, in corner order, numbers the unique vertices by first
+//    occurrence, exactly like the serial loop does
+void indexVBO_parallel(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
 
+	IndexBuffer & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	const size_t count = in_vertices.size();
+	if (count >= 0xFFFFFFFFu){
+		printf("indexVBO_parallel : too many vertices\n");
+		return;
+	}
+	const size_t MIN_BLOCK = 1 << 14;
+	auto isSame = [&](size_t a, size_t b){
+		return memcmp(&in_vertices[a], &in_vertices[b], sizeof(glm::vec3)) == 0 &&
+			memcmp(&in_uvs[a], &in_uvs[b], sizeof(glm::vec2)) == 0 &&
+			memcmp(&in_normals[a], &in_normals[b], sizeof(glm::vec3)) == 0;
+	};
 
+	// 1. Stable counting sort of the corners by bucket. Each block counts its corners per bucket,
+	// and the (bucket, block) prefix sum tells every block where to write.
+	const size_t bucketCount = (size_t)workerThreadCount() * 16;
+	const size_t blockCount = parallelBlockCount(count, MIN_BLOCK);
+	std::vector<uint64_t> hashes(count);
+	std::vector<uint32_t> bucketOf(count);
+	std::vector<size_t> offsets(blockCount * bucketCount, 0);
+	parallelFor(blockCount, [&](size_t b){
+		size_t * blockOffsets = &offsets[b * bucketCount];
+		for (size_t i = count * b / blockCount; i < count * (b + 1) / blockCount; ++i){
+			PackedVertex packed = {in_vertices[i], in_uvs[i], in_normals[i]};
+			hashes[i] = hashPackedVertex(packed);
+			bucketOf[i] = (uint32_t)(((hashes[i] >> 32) * bucketCount) >> 32);
+			++blockOffsets[bucketOf[i]];
+		}
+	});
+	std::vector<size_t> bucketStart(bucketCount + 1);
+	size_t total = 0;
+	for (size_t k = 0; k < bucketCount; ++k){
+		bucketStart[k] = total;
+		for (size_t b = 0; b < blockCount; ++b){
+			size_t n = offsets[b * bucketCount + k];
+			offsets[b * bucketCount + k] = total;
+			total += n;
+		}
+	}
+	bucketStart[bucketCount] = total;
+	std::vector<uint32_t> order(count);
+	parallelFor(blockCount, [&](size_t b){
+		size_t * blockOffsets = &offsets[b * bucketCount];
+		for (size_t i = count * b / blockCount; i < count * (b + 1) / blockCount; ++i)
+			order[blockOffsets[bucketOf[i]]++] = (uint32_t)i;
+	});
+	std::vector<uint32_t>().swap(bucketOf);
 
+	// 2. Corners come in increasing order within a bucket, so the first one inserted is the first occurrence
+	std::vector<uint32_t> representative(count);
+	parallelFor(bucketCount, [&](size_t k){
+		IdHashTable table((bucketStart[k + 1] - bucketStart[k]) / 4);
+		for (size_t j = bucketStart[k]; j < bucketStart[k + 1]; ++j){
+			const uint32_t i = order[j];
+			representative[i] = table.findOrInsert(hashes[i], i, [&](uint32_t candidate){ return isSame(candidate, i); });
+		}
+	});
+	std::vector<uint32_t>().swap(order);
+	std::vector<uint64_t>().swap(hashes);
 
-
+	// 3. Number the representatives : per-block counts, exclusive prefix sum, then per-block numbering
+	const size_t base = out_vertices.size();
+	std::vector<size_t> blockFirst(blockCount + 1, 0);
+	parallelFor(blockCount, [&](size_t b){
+		size_t n = 0;
+		for (size_t i = count * b / blockCount; i < count * (b + 1) / blockCount; ++i)
+			n += (representative[i] == i);
+		blockFirst[b + 1] = n;
+	});
+	for (size_t b = 0; b < blockCount; ++b)
+		blockFirst[b + 1] += blockFirst[b];
+	const size_t uniqueCount = blockFirst[blockCount];
+	out_vertices.resize(base + uniqueCount);
+	out_uvs.resize(base + uniqueCount);
+	out_normals.resize(base + uniqueCount);
+	std::vector<unsigned int> indices(count);
+	parallelFor(blockCount, [&](size_t b){
+		size_t next = base + blockFirst[b];
+		for (size_t i = count * b / blockCount; i < count * (b + 1) / blockCount; ++i){
+			if (representative[i] != i)
+				continue;
+			out_vertices[next] = in_vertices[i];
+			out_uvs[next] = in_uvs[i];
+			out_normals[next] = in_normals[i];
+			indices[i] = (unsigned int)next++;
+		}
+	});
+	// Every representative is numbered by now ; the other corners take its index
+	parallelForBlocks(count, MIN_BLOCK, [&](size_t begin, size_t end){
+		for (size_t i = begin; i < end; ++i)
+			if (representative[i] != i)
+				indices[i] = indices[representative[i]];
+	});
+	out_indices.assign(indices, out_vertices.size());
+}
 
 void indexVBO_TBN(
 	std::vector<glm::vec3> & in_vertices,
@@ -145,22 +352,27 @@ void indexVBO_TBN(
 	std::vector<glm::vec3> & in_tangents,
 	std::vector<glm::vec3> & in_bitangents,
 
-	std::vector<unsigned short> & out_indices,
+	IndexBuffer & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals,
 	std::vector<glm::vec3> & out_tangents,
 	std::vector<glm::vec3> & out_bitangents
 ){
+	SimilarVertexGrid grid(in_vertices.size() / 4);
+	for ( size_t i=0; i<out_vertices.size(); i++ )
+		grid.insert(out_vertices[i], (unsigned int)i);
+	std::vector<unsigned int> indices(in_vertices.size());
+
 	// For each input vertex
-	for ( unsigned int i=0; i<in_vertices.size(); i++ ){
+	for ( size_t i=0; i<in_vertices.size(); i++ ){
 
 		// Try to find a similar vertex in out_XXXX
-		unsigned short index;
-		bool found = getSimilarVertexIndex(in_vertices[i], in_uvs[i], in_normals[i],     out_vertices, out_uvs, out_normals, index);
+		unsigned int index;
+		bool found = grid.find(in_vertices[i], in_uvs[i], in_normals[i],     out_vertices, out_uvs, out_normals, index);
 
 		if ( found ){ // A similar vertex is already in the VBO, use it instead !
-			out_indices.push_back( index );
+			indices[i] = index;
 
 			// Average the tangents and the bitangents
 			out_tangents[index] += in_tangents[i];
@@ -171,7 +383,9 @@ void indexVBO_TBN(
 			out_normals .push_back( in_normals[i]);
 			out_tangents .push_back( in_tangents[i]);
 			out_bitangents .push_back( in_bitangents[i]);
-			out_indices .push_back( (unsigned short)out_vertices.size() - 1 );
+			indices[i] = (unsigned int)out_vertices.size() - 1;
+			grid.insert(in_vertices[i], indices[i]);
 		}
 	}
+	out_indices.assign(indices, out_vertices.size());
 }
@@ -1,18 +1,60 @@
 #ifndef VBOINDEXER_HPP
 #define VBOINDEXER_HPP
 
+// Index buffer whose width follows the number of vertices it refers to : 16-bit indices while
+// every vertex is reachable with them (up to 65536 vertices), 32-bit ones beyond.
+// Draw with glDrawElements(mode, size(), is32Bit() ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT, ...)
+// after uploading byteSize() bytes from data().
+class IndexBuffer {
+public:
+	IndexBuffer() : wide(false) { }
+
+	// Stores the indices with the smallest width that can address vertexCount vertices
+	void assign(const std::vector<unsigned int> & indices, size_t vertexCount);
+	void clear();
+
+	bool is32Bit() const { return wide; }
+	size_t size() const { return wide ? indices32.size() : indices16.size(); }
+	size_t elementSize() const { return wide ? sizeof(unsigned int) : sizeof(unsigned short); }
+	size_t byteSize() const { return size() * elementSize(); }
+	const void * data() const { return wide ? (const void *)indices32.data() : (const void *)indices16.data(); }
+	unsigned int operator[](size_t i) const { return wide ? indices32[i] : indices16[i]; }
+
+private:
+	bool wide;
+	std::vector<unsigned short> indices16;
+	std::vector<unsigned int> indices32;
+};
+
+// Merges bitwise identical vertices (same position, uv and normal).
+// Unique vertices are appended to out_vertices / out_uvs / out_normals ; out_indices is replaced.
 void indexVBO(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
 
-	std::vector<unsigned short> & out_indices,
+	IndexBuffer & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals
 );
 
+// Same output as indexVBO, computed on workerThreadCount() threads ; worth it for big meshes
+// (roughly 1M corners and more)
+void indexVBO_parallel(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	IndexBuffer & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+);
 
+// Merges similar vertices (every component within 0.01 of an earlier vertex) and sums the
+// tangents and bitangents of the merged vertices.
+// Unique vertices are appended to the out_ arrays ; out_indices is replaced.
 void indexVBO_TBN(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
@@ -20,7 +62,7 @@ void indexVBO_TBN(
 	std::vector<glm::vec3> & in_tangents,
 	std::vector<glm::vec3> & in_bitangents,
 
-	std::vector<unsigned short> & out_indices,
+	IndexBuffer & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals,
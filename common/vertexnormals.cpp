@@ -0,0 +1,207 @@
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "hashtable.hpp"
+#include "parallel.hpp"
+#include "vertexnormals.hpp"
+
+namespace {
+
+// The corners of a position whose faces have exactly the same normal get the same result, so
+// the crease test runs between these buckets rather than between corners
+struct NormalBucket {
+	glm::vec3 normal;
+	glm::vec3 weighted;   // Sum of normal * corner angle over the bucket
+	glm::vec3 result;
+};
+
+bool normalBitsLess(const glm::vec3 & a, const glm::vec3 & b){
+	uint32_t x[3], y[3];
+	memcpy(x, &a, sizeof(x));
+	memcpy(y, &b, sizeof(y));
+	return x[0] != y[0] ? x[0] < y[0] : x[1] != y[1] ? x[1] < y[1] : x[2] < y[2];
+}
+
+} // namespace
+
+void computeCornerNormals(
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & positions,
+	float creaseAngle,
+	std::vector<glm::vec3> & cornerNormals
+){
+	const size_t triangleCount = indices.size() / 3;
+	const size_t MIN_BLOCK = 1 << 12;
+	cornerNormals.resize(3 * triangleCount);
+	if (triangleCount == 0)
+		return;
+
+	// 1. Unit face normals, and the angle of every corner, in parallel over triangles
+	std::vector<glm::vec3> faceNormals(triangleCount);
+	std::vector<float> cornerAngles(3 * triangleCount);
+	parallelForBlocks(triangleCount, MIN_BLOCK, [&](size_t begin, size_t end){
+		for (size_t t = begin; t < end; ++t){
+			const glm::vec3 p[3] = { positions[indices[3 * t]], positions[indices[3 * t + 1]], positions[indices[3 * t + 2]] };
+			glm::vec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+			float length = glm::length(n);
+			faceNormals[t] = length > 0.0f ? n / length : glm::vec3(0.0f);
+			for (int k = 0; k < 3; ++k){
+				glm::vec3 e1 = p[(k + 1) % 3] - p[k], e2 = p[(k + 2) % 3] - p[k];
+				float lengths = glm::length(e1) * glm::length(e2);
+				cornerAngles[3 * t + k] = lengths > 0.0f ? acosf(glm::clamp(glm::dot(e1, e2) / lengths, -1.0f, 1.0f)) : 0.0f;
+			}
+		}
+	});
+
+	// 2. Group the corners by position, numbering the positions by first use, then list the corners
+	// of every position in corner order (counting sort)
+	std::vector<unsigned int> cornerGroup(indices.size());
+	std::vector<unsigned int> groupOfVertex(positions.size(), IdHashTable::NOT_FOUND);
+	size_t groupCount = 0;
+	{
+		std::vector<unsigned int> groupVertex;
+		IdHashTable table(positions.size());
+		for (size_t i = 0; i < indices.size(); ++i){
+			const unsigned int v = indices[i];
+			if (groupOfVertex[v] == IdHashTable::NOT_FOUND){
+				const glm::vec3 & p = positions[v];
+				uint32_t bits[3];
+				memcpy(bits, &p, sizeof(bits));
+				groupOfVertex[v] = table.findOrInsert(IdHashTable::hashWords(bits, 3), (uint32_t)groupVertex.size(),
+					[&](uint32_t id){ return memcmp(&positions[groupVertex[id]], &p, sizeof(glm::vec3)) == 0; });
+				if (groupOfVertex[v] == groupVertex.size())
+					groupVertex.push_back(v);
+			}
+			cornerGroup[i] = groupOfVertex[v];
+		}
+		groupCount = groupVertex.size();
+	}
+	std::vector<unsigned int> groupStart(groupCount + 1, 0);
+	for (size_t i = 0; i < indices.size(); ++i)
+		++groupStart[cornerGroup[i] + 1];
+	for (size_t g = 0; g < groupCount; ++g)
+		groupStart[g + 1] += groupStart[g];
+	std::vector<unsigned int> corners(indices.size());
+	{
+		std::vector<unsigned int> filled(groupStart.begin(), groupStart.end() - 1);
+		for (size_t i = 0; i < indices.size(); ++i)
+			corners[filled[cornerGroup[i]]++] = (unsigned int)i;
+	}
+
+	// 3. Average around every position, in parallel over positions. Each sum runs over the corners
+	// in the same order whatever the threads, so the result is deterministic.
+	// With a crease, the corners are bucketed by face normal (sorted, O(k log k) for k corners). When
+	// every bucket lies within half the crease angle of their mean direction, every pair passes the
+	// test and all corners get the full sum (smooth poles, flat caps) ; otherwise the buckets are
+	// compared pairwise, which is quadratic only in the number of distinct normals.
+	const bool smoothAll = creaseAngle >= 180.0f;
+	const float creaseCosine = cosf(glm::radians(glm::min(creaseAngle, 180.0f)));
+	const float halfCreaseCosine = cosf(glm::radians(glm::min(creaseAngle, 180.0f) * 0.5f));
+	parallelForBlocks(groupCount, MIN_BLOCK, [&](size_t begin, size_t end){
+		std::vector<unsigned int> sorted;
+		std::vector<NormalBucket> buckets;
+		std::vector<unsigned int> sortedBucket;
+		for (size_t g = begin; g < end; ++g){
+			const unsigned int * list = &corners[groupStart[g]];
+			const unsigned int count = groupStart[g + 1] - groupStart[g];
+			if (smoothAll){
+				glm::vec3 all(0.0f);
+				for (unsigned int a = 0; a < count; ++a)
+					all += faceNormals[list[a] / 3] * cornerAngles[list[a]];
+				float length = glm::length(all);
+				for (unsigned int a = 0; a < count; ++a)
+					cornerNormals[list[a]] = length > 0.0f ? all / length : faceNormals[list[a] / 3];
+				continue;
+			}
+
+			sorted.assign(list, list + count);
+			std::sort(sorted.begin(), sorted.end(), [&](unsigned int a, unsigned int b){
+				const glm::vec3 & na = faceNormals[a / 3], & nb = faceNormals[b / 3];
+				if (normalBitsLess(na, nb)) return true;
+				if (normalBitsLess(nb, na)) return false;
+				return a < b;
+			});
+			buckets.clear();
+			sortedBucket.resize(count);
+			for (unsigned int a = 0; a < count; ++a){
+				const glm::vec3 & n = faceNormals[sorted[a] / 3];
+				if (buckets.empty() || memcmp(&buckets.back().normal, &n, sizeof(n)) != 0){
+					NormalBucket bucket = { n, glm::vec3(0.0f), glm::vec3(0.0f) };
+					buckets.push_back(bucket);
+				}
+				buckets.back().weighted += n * cornerAngles[sorted[a]];
+				sortedBucket[a] = (unsigned int)buckets.size() - 1;
+			}
+
+			glm::vec3 mean(0.0f), all(0.0f);
+			for (size_t b = 0; b < buckets.size(); ++b){
+				mean += buckets[b].normal;
+				all += buckets[b].weighted;
+			}
+			const float meanLength = glm::length(mean);
+			bool oneCone = meanLength > 0.0f;
+			for (size_t b = 0; oneCone && b < buckets.size(); ++b)
+				oneCone = glm::dot(mean, buckets[b].normal) >= halfCreaseCosine * meanLength;
+
+			for (size_t b = 0; b < buckets.size(); ++b){
+				glm::vec3 sum = all;
+				if (!oneCone){
+					sum = glm::vec3(0.0f);
+					for (size_t o = 0; o < buckets.size(); ++o)
+						if (glm::dot(buckets[b].normal, buckets[o].normal) >= creaseCosine)
+							sum += buckets[o].weighted;
+				}
+				float length = glm::length(sum);
+				buckets[b].result = length > 0.0f ? sum / length : buckets[b].normal;
+			}
+			for (unsigned int a = 0; a < count; ++a)
+				cornerNormals[sorted[a]] = buckets[sortedBucket[a]].result;
+		}
+	});
+}
+
+void generateNormals(
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & positions,
+	std::vector<glm::vec3> & normals,
+	float creaseAngle,
+	std::vector<unsigned int> * splitSources
+){
+	std::vector<glm::vec3> cornerNormals;
+	computeCornerNormals(indices, positions, creaseAngle, cornerNormals);
+
+	// The first corner of a vertex sets its normal ; corners with another normal go to a copy,
+	// shared by the corners with that same normal. Copies of a vertex are chained through nextCopy.
+	const size_t originalCount = positions.size();
+	normals.assign(originalCount, glm::vec3(0.0f));
+	std::vector<char> assigned(originalCount, 0);
+	std::vector<unsigned int> nextCopy(originalCount, IdHashTable::NOT_FOUND);
+	for (size_t i = 0; i < indices.size(); ++i){
+		unsigned int v = indices[i];
+		const glm::vec3 & n = cornerNormals[i];
+		if (!assigned[v]){
+			assigned[v] = 1;
+			normals[v] = n;
+			continue;
+		}
+		unsigned int last = v;
+		while (normals[last] != n && nextCopy[last] != IdHashTable::NOT_FOUND)
+			last = nextCopy[last];
+		if (normals[last] != n){
+			unsigned int copy = (unsigned int)positions.size();
+			glm::vec3 p = positions[v];
+			positions.push_back(p);
+			normals.push_back(n);
+			nextCopy.push_back(IdHashTable::NOT_FOUND);
+			nextCopy[last] = copy;
+			if (splitSources)
+				splitSources->push_back(v);
+			last = copy;
+		}
+		indices[i] = last;
+	}
+}
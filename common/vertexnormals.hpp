@@ -0,0 +1,43 @@
+#ifndef VERTEXNORMALS_HPP
+#define VERTEXNORMALS_HPP
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Smooth normals for meshes that come without them (scans, some OBJ exports).
+// Every corner gets the angle-weighted average of the face normals around its position, counting
+// only the faces within creaseAngle degrees of its own face : edges sharper than that stay hard.
+// creaseAngle 180 smooths everything. Vertices with the same position share their normals, even
+// when they are distinct vertices (uv seams). Runs on workerThreadCount() threads ; the result
+// does not depend on their number. Counter-clockwise faces are front faces.
+
+// One normal per index (per triangle corner), e.g. for de-indexed vertex streams
+void computeCornerNormals(
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & positions,
+	float creaseAngle,
+	std::vector<glm::vec3> & cornerNormals
+);
+
+// One normal per vertex. A vertex whose corners get different normals across a crease is split :
+// the copies are appended to positions (and normals) and indices are updated. Each copy's original
+// vertex is appended to splitSources, if given ; pass it to appendSplitVertices for every other
+// vertex stream.
+void generateNormals(
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & positions,
+	std::vector<glm::vec3> & normals,
+	float creaseAngle = 180.0f,
+	std::vector<unsigned int> * splitSources = NULL
+);
+
+template <typename T>
+void appendSplitVertices(std::vector<T> & stream, const std::vector<unsigned int> & splitSources){
+	stream.reserve(stream.size() + splitSources.size());
+	for (size_t i = 0; i < splitSources.size(); ++i){
+		T copy = stream[splitSources[i]];
+		stream.push_back(copy);
+	}
+}
+
+#endif
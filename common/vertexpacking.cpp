@@ -0,0 +1,116 @@
+#include <vector>
+#include <cstring>
+#include <cmath>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "vertexpacking.hpp"
+
+// The packers of glm/gtc/packing.hpp (0.9.7) pun vectors through reinterpret_cast, which breaks
+// strict aliasing ; the two layouts it would provide are built with shifts instead. The core
+// pack*2x16 functions go through unions and are fine.
+namespace {
+
+uint64_t packUnorm16(float value, int shift){
+	return (uint64_t)(uint16_t)glm::round(glm::clamp(value, 0.0f, 1.0f) * 65535.0f) << shift;
+}
+
+uint32_t packSnorm10(float value, int shift){
+	// Two's complement in 10 bits
+	return ((uint32_t)(int)glm::round(glm::clamp(value, -1.0f, 1.0f) * 511.0f) & 0x3FFu) << shift;
+}
+
+} // namespace
+
+uint32_t encodeOctahedralNormal(const glm::vec3 & n){
+	// Project onto the octahedron |x| + |y| + |z| = 1, then fold the lower half over the upper one
+	float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	if (l1 == 0.0f)
+		return glm::packSnorm2x16(glm::vec2(0.0f));
+	glm::vec2 e(n.x / l1, n.y / l1);
+	if (n.z < 0.0f){
+		glm::vec2 folded((1.0f - fabsf(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f),
+		                 (1.0f - fabsf(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f));
+		e = folded;
+	}
+	return glm::packSnorm2x16(e);
+}
+
+glm::vec3 decodeOctahedralNormal(uint32_t packed){
+	glm::vec2 e = glm::unpackSnorm2x16(packed);
+	glm::vec3 n(e.x, e.y, 1.0f - fabsf(e.x) - fabsf(e.y));
+	if (n.z < 0.0f){
+		n.x = (1.0f - fabsf(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f);
+		n.y = (1.0f - fabsf(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return glm::normalize(n);
+}
+
+void quantizeMesh(
+	const std::vector<glm::vec3> & positions,
+	const std::vector<glm::vec3> & normals,
+	const std::vector<glm::vec2> & uvs,
+	NormalEncoding normalEncoding,
+	QuantizedMesh & out
+){
+	out.vertexCount = positions.size();
+	out.hasUVs = !uvs.empty();
+	out.normalEncoding = normalEncoding;
+	out.stride = out.hasUVs ? 16 : 12;
+
+	glm::vec3 boundsMax(0.0f);
+	out.boundsMin = glm::vec3(0.0f);
+	for (size_t i = 0; i < positions.size(); ++i){
+		out.boundsMin = (i == 0) ? positions[i] : glm::min(out.boundsMin, positions[i]);
+		boundsMax = (i == 0) ? positions[i] : glm::max(boundsMax, positions[i]);
+	}
+	glm::vec3 extent = boundsMax - out.boundsMin;
+	out.boundsSize = glm::max(extent.x, glm::max(extent.y, extent.z));
+	const float inverseSize = out.boundsSize > 0.0f ? 1.0f / out.boundsSize : 0.0f;
+
+	out.vertexData.resize(out.vertexCount * out.stride);
+	for (size_t i = 0; i < out.vertexCount; ++i){
+		unsigned char * vertex = &out.vertexData[i * out.stride];
+
+		glm::vec3 p = (positions[i] - out.boundsMin) * inverseSize;
+		uint64_t position = packUnorm16(p.x, 0) | packUnorm16(p.y, 16) | packUnorm16(p.z, 32);
+		memcpy(vertex, &position, 8);
+
+		uint32_t normal;
+		if (normalEncoding == NORMAL_SNORM_10_10_10_2){
+			glm::vec3 n = normals[i];
+			float length = glm::length(n);
+			if (length > 0.0f) n /= length;
+			normal = packSnorm10(n.x, 0) | packSnorm10(n.y, 10) | packSnorm10(n.z, 20);
+		}else{
+			normal = encodeOctahedralNormal(normals[i]);
+		}
+		memcpy(vertex + 8, &normal, 4);
+
+		if (out.hasUVs){
+			uint32_t uv = glm::packHalf2x16(uvs[i]);
+			memcpy(vertex + 12, &uv, 4);
+		}
+	}
+}
+
+glm::mat4 QuantizedMesh::decodeMatrix() const {
+	return glm::scale(glm::translate(glm::mat4(1.0f), boundsMin), glm::vec3(boundsSize));
+}
+
+void QuantizedMesh::setupAttributes(GLuint positionLocation, GLuint normalLocation, GLint uvLocation) const {
+	glEnableVertexAttribArray(positionLocation);
+	glVertexAttribPointer(positionLocation, 3, GL_UNSIGNED_SHORT, GL_TRUE, (GLsizei)stride, (void*)0);
+	glEnableVertexAttribArray(normalLocation);
+	if (normalEncoding == NORMAL_SNORM_10_10_10_2)
+		glVertexAttribPointer(normalLocation, 4, GL_INT_2_10_10_10_REV, GL_TRUE, (GLsizei)stride, (void*)8);
+	else
+		glVertexAttribPointer(normalLocation, 2, GL_SHORT, GL_TRUE, (GLsizei)stride, (void*)8);
+	if (hasUVs && uvLocation >= 0){
+		glEnableVertexAttribArray((GLuint)uvLocation);
+		glVertexAttribPointer((GLuint)uvLocation, 2, GL_HALF_FLOAT, GL_FALSE, (GLsizei)stride, (void*)12);
+	}
+}
@@ -0,0 +1,104 @@
+#ifndef WORKQUEUE_HPP
+#define WORKQUEUE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "parallel.hpp"
+
+// Background jobs of the streaming loaders (AssetLoader, TextureLoader) : jobs are pushed by the
+// owning thread, processed by a pool of worker threads, and handed back to the owning thread in
+// completion order. Job must have a `Job * next` member, used by the completion list ; the queue
+// never owns the jobs, they must outlive it (declare the queue after the records).
+template <typename Job>
+class WorkQueue {
+public:
+	// threadCount 0 : workerThreadCount(). process runs on the workers, once per job.
+	WorkQueue(unsigned int threadCount, const std::function<void(Job &)> & inProcess)
+		: process(inProcess), stopping(false), completed(NULL)
+	{
+		if (threadCount == 0)
+			threadCount = workerThreadCount();
+		for (unsigned int t = 0; t < threadCount; ++t)
+			workers.push_back(std::thread(&WorkQueue::workerLoop, this));
+	}
+
+	// Drops the jobs not started yet and waits for the workers
+	~WorkQueue(){
+		{
+			std::lock_guard<std::mutex> lock(jobMutex);
+			stopping = true;
+			jobs.clear();
+		}
+		jobReady.notify_all();
+		for (size_t t = 0; t < workers.size(); ++t)
+			workers[t].join();
+	}
+
+	void push(Job * job){
+		job->next = NULL;
+		{
+			std::lock_guard<std::mutex> lock(jobMutex);
+			jobs.push_back(job);
+		}
+		jobReady.notify_one();
+	}
+
+	// Owning thread only. Appends the jobs finished since the last call to finished, oldest first.
+	void takeCompleted(std::deque<Job *> & finished){
+		// The workers push most recent first : reverse while appending
+		Job * list = completed.exchange(NULL, std::memory_order_acquire);
+		const size_t first = finished.size();
+		for (; list != NULL; list = list->next)
+			finished.insert(finished.begin() + first, list);
+	}
+
+private:
+	WorkQueue(const WorkQueue &);
+	WorkQueue & operator=(const WorkQueue &);
+
+	void workerLoop(){
+		for (;;){
+			Job * job;
+			{
+				std::unique_lock<std::mutex> lock(jobMutex);
+				while (!stopping && jobs.empty())
+					jobReady.wait(lock);
+				if (stopping)
+					return;
+				job = jobs.front();
+				jobs.pop_front();
+			}
+			process(*job);
+			publish(job);
+		}
+	}
+
+	void publish(Job * job){
+		// The release on success makes the worker's writes to the job visible to takeCompleted
+		Job * head = completed.load(std::memory_order_relaxed);
+		do {
+			job->next = head;
+		} while (!completed.compare_exchange_weak(head, job, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	std::function<void(Job &)> process;
+
+	// Jobs waiting for a worker
+	std::mutex jobMutex;
+	std::condition_variable jobReady;
+	std::deque<Job *> jobs;
+	bool stopping;
+	std::vector<std::thread> workers;
+
+	// Finished jobs, pushed by the workers (most recent first) and taken all at once by the
+	// owning thread, so a compare-and-swap on the head is all the synchronisation needed
+	std::atomic<Job *> completed;
+};
+
+#endif
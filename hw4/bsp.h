@@ -11,9 +11,22 @@ using namespace std;
 
 #include <GL/glew.h>
 
+#include <common/shaderprogram.hpp>
+
 #define EPSILON 1.0e-5f
 #define EQUAL(x,y) (glm::all(glm::lessThan(glm::abs((x) - (y)), glm::vec3(EPSILON))))
 
+// Material uniforms of the polygons, found once per program
+struct PolygonUniforms {
+    Uniform<glm::vec3> Kd, Ka, Ks;
+    Uniform<float> n;
+    Uniform<glm::vec4> color;
+
+    explicit PolygonUniforms(const ShaderProgram & program)
+      : Kd(program.uniform<glm::vec3>("Kd")), Ka(program.uniform<glm::vec3>("Ka")), Ks(program.uniform<glm::vec3>("Ks")),
+        n(program.uniform<float>("n")), color(program.uniform<glm::vec4>("material_color")) {}
+};
+
 class Polygon {
     // Simple, convex polygon
 public:
@@ -22,6 +35,7 @@ public:
     glm::vec3 Kd_value, Ka_value, Ks_value;
     glm::vec4 color;
     float n_value;
+    GLint first = -1;  // First vertex in the buffers of its BSPTree, set by BSPTree::upload
 
     Polygon(vector<glm::vec3>&, glm::vec3, glm::vec3, glm::vec3, float, glm::vec4);
     Polygon(vector<glm::vec3>&,vector<glm::vec3>&, glm::vec3, glm::vec3, glm::vec3, float, glm::vec4);
@@ -30,7 +44,7 @@ public:
     bool isFront(Polygon& other) const;
     bool isBehind(Polygon& other) const;
     bool isOnSamePlane(Polygon& other) const;
-    void draw(GLuint) const;
+    void draw(ShaderProgram&, const PolygonUniforms&) const;
     void apply(glm::mat4);
 };
 
@@ -180,48 +194,20 @@ bool Polygon::isOnSamePlane(Polygon &other) const {
   return EQUAL(plane_normal, other.plane_normal);
 }
 
-void Polygon::draw(GLuint programID) const {
-  GLuint vbo;
-  glGenBuffers(1, &vbo);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
-  glBufferData(GL_ARRAY_BUFFER,
-               sizeof(glm::vec3) * points.size(),
-               &points[0],
-               GL_STATIC_DRAW);
-
-  std::vector<glm::vec3> normals(points.size(), plane_normal);
-  GLuint normal_vbo;
-  glGenBuffers(1, &normal_vbo);
-  glBindBuffer(GL_ARRAY_BUFFER, normal_vbo);
-  glBufferData(GL_ARRAY_BUFFER,
-               sizeof(glm::vec3) * normals.size(),
-               &normals[0],
-               GL_STATIC_DRAW);
-
-  GLuint Kd = glGetUniformLocation(programID, "Kd");
-  GLuint Ka = glGetUniformLocation(programID, "Ka");
-  GLuint Ks = glGetUniformLocation(programID, "Ks");
-  GLuint n = glGetUniformLocation(programID, "n");
-  GLuint ColorID = glGetUniformLocation(programID, "material_color");
-
-  glUniform3f(Kd, Kd_value.x, Kd_value.y, Kd_value.z);
-  glUniform3f(Ka, Ka_value.x, Ka_value.y, Ka_value.z);
-  glUniform3f(Ks, Ks_value.x, Ks_value.y, Ks_value.z);
-  glUniform1f(n, n_value);
-
-  glUniform4f(ColorID, color.x, color.y, color.z, color.w);
-
-  glEnableVertexAttribArray(0);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-  glEnableVertexAttribArray(1);
-  glBindBuffer(GL_ARRAY_BUFFER, normal_vbo);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-  glDrawArrays(GL_TRIANGLE_FAN, 0, points.size());
-  glDisableVertexAttribArray(0);
-  glDisableVertexAttribArray(1);
+/**
+ * Draw polygon from the buffers bound by BSPTree::draw ; the material uniforms only cost a GL
+ * call when they change from the previous polygon
+ * @param program
+ * @param uniforms
+ */
+void Polygon::draw(ShaderProgram& program, const PolygonUniforms& uniforms) const {
+  program.set(uniforms.Kd, Kd_value);
+  program.set(uniforms.Ka, Ka_value);
+  program.set(uniforms.Ks, Ks_value);
+  program.set(uniforms.n, n_value);
+  program.set(uniforms.color, color);
+
+  glDrawArrays(GL_TRIANGLE_FAN, first, points.size());
 }
 
 void Polygon::apply(glm::mat4 transform) {
@@ -243,7 +229,8 @@ class BSPNode {
 public:
     BSPNode(std::vector<Polygon>);
     void print(int indent, int index);
-    void draw(glm::vec3, GLuint);
+    void draw(glm::vec3, ShaderProgram&, const PolygonUniforms&);
+    void upload(std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals);
     void apply(glm::mat4);
     bool isFront(glm::vec3&) const;
     bool isBehind(glm::vec3&) const;
@@ -336,30 +323,40 @@ bool BSPNode::isBehind(glm::vec3 &p) const {
   return ((float)glm::dot(p - point, normal) < -EPSILON);
 }
 
-void BSPNode::draw(glm::vec3 v, GLuint programID) {
+void BSPNode::draw(glm::vec3 v, ShaderProgram& program, const PolygonUniforms& uniforms) {
   if (!front && !behind) {
     for(auto const& polygon: polygons) {
-      polygon.draw(programID);
+      polygon.draw(program, uniforms);
     }
   }
   else if (isFront(v)) {
-    if (behind) behind->draw(v, programID);
+    if (behind) behind->draw(v, program, uniforms);
     for(auto const& polygon: polygons) {
-      polygon.draw(programID);
+      polygon.draw(program, uniforms);
     }
-    if (front) front->draw(v, programID);
+    if (front) front->draw(v, program, uniforms);
   }
   else if (isBehind(v)) {
-    if (front) front->draw(v, programID);
+    if (front) front->draw(v, program, uniforms);
     for(auto const& polygon: polygons) {
-      polygon.draw(programID);
+      polygon.draw(program, uniforms);
     }
-    if (behind) behind->draw(v, programID);
+    if (behind) behind->draw(v, program, uniforms);
   }
   else {
-    if (front) front->draw(v, programID);
-    if (behind) behind->draw(v, programID);
+    if (front) front->draw(v, program, uniforms);
+    if (behind) behind->draw(v, program, uniforms);
+  }
+}
+
+void BSPNode::upload(std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals) {
+  for(auto & polygon: polygons) {
+    polygon.first = (GLint)positions.size();
+    positions.insert(positions.end(), polygon.points.begin(), polygon.points.end());
+    normals.insert(normals.end(), polygon.points.size(), polygon.plane_normal);
   }
+  if (front) front->upload(positions, normals);
+  if (behind) behind->upload(positions, normals);
 }
 
 std::vector<Polygon> BSPNode::getPolygons() {
@@ -377,12 +374,19 @@ std::vector<Polygon> BSPNode::getPolygons() {
 class BSPTree {
     using node_ptr = std::unique_ptr<BSPNode>;
     node_ptr root;
+    // Every polygon of the tree, uploaded on the first draw after a change
+    GLuint vbo = 0, normal_vbo = 0;
+    bool uploaded = false;
+    std::unique_ptr<PolygonUniforms> uniforms;
+    GLuint uniforms_program = 0;
 public:
     BSPTree(std::vector<Polygon> polygons);
     BSPTree(std::vector<glm::vec3> & vertices, glm::vec3, glm::vec3, glm::vec3, float, glm::vec4);
     void print();
-    void draw(glm::vec3, GLuint);
+    void upload();
+    void draw(glm::vec3, ShaderProgram&);
     void apply(glm::mat4);
+    void release();
     std::vector<Polygon> getPolygons();
 };
 
@@ -411,12 +415,52 @@ void BSPTree::print() {
   root->print(0, 0);
 }
 
-void BSPTree::draw(glm::vec3 v, GLuint programID) {
-  root->draw(v, programID);
+/**
+ * Copy the polygons to the vertex buffers, as triangle fans ; each polygon remembers where
+ */
+void BSPTree::upload() {
+  std::vector<glm::vec3> positions, normals;
+  root->upload(positions, normals);
+  if (vbo == 0) glGenBuffers(1, &vbo);
+  if (normal_vbo == 0) glGenBuffers(1, &normal_vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * positions.size(), positions.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, normal_vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * normals.size(), normals.data(), GL_STATIC_DRAW);
+  uploaded = true;
+}
+
+void BSPTree::draw(glm::vec3 v, ShaderProgram& program) {
+  if (!uploaded) upload();
+  if (!uniforms || uniforms_program != program.id()) {
+    uniforms.reset(new PolygonUniforms(program));
+    uniforms_program = program.id();
+  }
+
+  glEnableVertexAttribArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+  glEnableVertexAttribArray(1);
+  glBindBuffer(GL_ARRAY_BUFFER, normal_vbo);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+  root->draw(v, program, *uniforms);
+
+  glDisableVertexAttribArray(0);
+  glDisableVertexAttribArray(1);
 }
 
 void BSPTree::apply(glm::mat4 transform) {
   root->apply(transform);
+  uploaded = false;
+}
+
+void BSPTree::release() {
+  if (vbo != 0) glDeleteBuffers(1, &vbo);
+  if (normal_vbo != 0) glDeleteBuffers(1, &normal_vbo);
+  vbo = normal_vbo = 0;
+  uploaded = false;
 }
 
 std::vector<Polygon> BSPTree::getPolygons() {
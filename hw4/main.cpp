@@ -16,6 +16,7 @@ GLFWwindow* window;
 using namespace glm;
 
 #include <common/shader.hpp>
+#include <common/shaderprogram.hpp>
 #include <common/controls.hpp>
 #include <common/objloader.hpp>
 
@@ -76,6 +77,10 @@ int main( void )
     return -1;
   }
   RawSurface rawSurface = RawSurface::createFromFile("./knight.txt");
+  if (rawSurface.sections.empty()) {
+    exit_glfw();
+    return -1;
+  }
   Surface surface = Surface(rawSurface);
 
   GLfloat *vertices = (GLfloat*)malloc(sizeof(GLfloat) * surface.meshDataSize());
@@ -90,12 +95,15 @@ int main( void )
   glGenVertexArrays(1, &vao);
   glBindVertexArray(vao);
 
-  GLuint programID = LoadShaders( "./shader/Basic.vert", "./shader/LightShading.frag" );
+  // Later runs load the linked program instead of compiling it
+  setProgramCacheDirectory("./shader");
+  ShaderProgram program;
+  program.load( "./shader/Basic.vert", "./shader/LightShading.frag" );
 
   // Get a handle for our "MVP" uniform
-  GLuint MatrixID = glGetUniformLocation(programID, "MVP");
-  GLuint ViewMatrixID = glGetUniformLocation(programID, "V");
-  GLuint ModelMatrixID = glGetUniformLocation(programID, "M");
+  Uniform<glm::mat4> MatrixID = program.uniform<glm::mat4>("MVP");
+  Uniform<glm::mat4> ViewMatrixID = program.uniform<glm::mat4>("V");
+  Uniform<glm::mat4> ModelMatrixID = program.uniform<glm::mat4>("M");
 
   // Opaque object
   GLuint bspline_vbo;
@@ -202,19 +210,19 @@ int main( void )
   BSPTree merge_bsp = BSPTree(merge_polygons);
 
   // Get a handle for our "LightPosition" uniform
-  glUseProgram(programID);
-  GLuint LightID1 = glGetUniformLocation(programID, "LightPosition_worldspace1");
-  GLuint LightID2 = glGetUniformLocation(programID, "LightPosition_worldspace2");
-  GLuint LightID3 = glGetUniformLocation(programID, "LightPosition_worldspace3");
-  GLuint LightID4 = glGetUniformLocation(programID, "LightPosition_worldspace4");
-  GLuint LightID5 = glGetUniformLocation(programID, "LightPosition_worldspace5");
-  GLuint LightID6 = glGetUniformLocation(programID, "LightPosition_worldspace6");
-  GLuint ColorID = glGetUniformLocation(programID, "material_color");
-
-  GLuint Kd = glGetUniformLocation(programID, "Kd");
-  GLuint Ka = glGetUniformLocation(programID, "Ka");
-  GLuint Ks = glGetUniformLocation(programID, "Ks");
-  GLuint n = glGetUniformLocation(programID, "n");
+  program.use();
+  Uniform<glm::vec3> LightID1 = program.uniform<glm::vec3>("LightPosition_worldspace1");
+  Uniform<glm::vec3> LightID2 = program.uniform<glm::vec3>("LightPosition_worldspace2");
+  Uniform<glm::vec3> LightID3 = program.uniform<glm::vec3>("LightPosition_worldspace3");
+  Uniform<glm::vec3> LightID4 = program.uniform<glm::vec3>("LightPosition_worldspace4");
+  Uniform<glm::vec3> LightID5 = program.uniform<glm::vec3>("LightPosition_worldspace5");
+  Uniform<glm::vec3> LightID6 = program.uniform<glm::vec3>("LightPosition_worldspace6");
+  Uniform<glm::vec4> ColorID = program.uniform<glm::vec4>("material_color");
+
+  Uniform<glm::vec3> Kd = program.uniform<glm::vec3>("Kd");
+  Uniform<glm::vec3> Ka = program.uniform<glm::vec3>("Ka");
+  Uniform<glm::vec3> Ks = program.uniform<glm::vec3>("Ks");
+  Uniform<float> n = program.uniform<float>("n");
 
   // Enable depth test
   glEnable(GL_DEPTH_TEST);
@@ -230,7 +238,7 @@ int main( void )
     // Clear the screen
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glUseProgram(programID);
+    program.use();
 
     // Compute the BodyMVP matrix from keyboard and mouse input
     computeMatricesFromInputs();
@@ -240,25 +248,25 @@ int main( void )
     glm::mat4 BodyMVP = ProjectionMatrix * ViewMatrix * BodyModelMatrix;
 
     // Send our transformation to the currently bound shader,
-    // in the "BodyMVP" uniform
-    glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &BodyMVP[0][0]);
-    glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &BodyModelMatrix[0][0]);
-    glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
-
-    glUniform3f(LightID1, 37.0f, 8.0f, 0.0f);
-    glUniform3f(LightID2, 5.0f, 40.0f, 0.0f);
-    glUniform3f(LightID3, 5.0f, 8.0f, 32.0f);
-    glUniform3f(LightID4, -27.0f, 8.0f, 0.0f);
-    glUniform3f(LightID5, 5.0f, -24.0f, 0.0f);
-    glUniform3f(LightID6, 5.0f, 8.0f, -32.0f);
-
-    glUniform3f(Kd, 1.0f, 1.0f, 1.0f);
-    glUniform3f(Ka, 0.2f, 0.2f, 0.2f);
-    glUniform3f(Ks, 0.5f, 0.5f, 0.5f);
-    glUniform1f(n, 5.0f);
+    // in the "BodyMVP" uniform ; values that did not change since the last frame are skipped
+    program.set(MatrixID, BodyMVP);
+    program.set(ModelMatrixID, BodyModelMatrix);
+    program.set(ViewMatrixID, ViewMatrix);
+
+    program.set(LightID1, glm::vec3(37.0f, 8.0f, 0.0f));
+    program.set(LightID2, glm::vec3(5.0f, 40.0f, 0.0f));
+    program.set(LightID3, glm::vec3(5.0f, 8.0f, 32.0f));
+    program.set(LightID4, glm::vec3(-27.0f, 8.0f, 0.0f));
+    program.set(LightID5, glm::vec3(5.0f, -24.0f, 0.0f));
+    program.set(LightID6, glm::vec3(5.0f, 8.0f, -32.0f));
+
+    program.set(Kd, glm::vec3(1.0f, 1.0f, 1.0f));
+    program.set(Ka, glm::vec3(0.2f, 0.2f, 0.2f));
+    program.set(Ks, glm::vec3(0.5f, 0.5f, 0.5f));
+    program.set(n, 5.0f);
 
     glm::vec4 knightColor = glm::vec4(1,1,1,1);
-    glUniform4f(ColorID, knightColor.x, knightColor.y, knightColor.z, knightColor.w);
+    program.set(ColorID, knightColor);
 
     glEnableVertexAttribArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, bspline_vbo);
@@ -273,7 +281,7 @@ int main( void )
     glDisableVertexAttribArray(1);
 
     glm::vec3 v = getEye();
-    merge_bsp.draw(v, programID);
+    merge_bsp.draw(v, program);
 
     // Swap buffers
     glfwSwapBuffers(window);
@@ -286,5 +294,10 @@ int main( void )
          glfwWindowShouldClose(window) == 0 );
 
   glFinish();
+
+  // Cleanup VBO and shader, while the context is still there
+  merge_bsp.release();
+  glDeleteProgram(program.id());
+
   exit_glfw();
 }
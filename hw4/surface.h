@@ -1,12 +1,17 @@
 #ifndef GRAPHICS_SURFACE_H
 #define GRAPHICS_SURFACE_H
 
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
 #include <vector>
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <common/mappedfile.hpp>
+#include <common/fastparse.hpp>
+
 #include "spline.h"
 
 static const int N_SPLINE = 20;
@@ -24,62 +29,112 @@ public:
     glm::vec3 position;
 };
 
+// Component planes of a SurfaceGrid
+enum GridPlane {
+    GRID_PX, GRID_PY, GRID_PZ,  // points
+    GRID_TX, GRID_TY, GRID_TZ,  // tangents
+    GRID_NX, GRID_NY, GRID_NZ,  // normals
+    GRID_PLANE_COUNT
+};
+
+class SurfaceGrid {
+    // Tessellated surface stored as one contiguous allocation in SoA layout.
+    // Each plane is a (rows x stride) float array : rows are sections, columns are points along the closed section curve.
+    // Every row carries one ghost column on each side (copies of the last / first point)
+    // so neighbour lookups along a section never need modulo arithmetic.
+public:
+    size_t rows = 0, cols = 0;
+    size_t stride = 0;        // Floats between two consecutive rows of a plane (cols + 2 ghost columns)
+    size_t plane_stride = 0;  // Floats between two consecutive planes
+    std::vector<float> data;
+
+    void resize(size_t rows, size_t cols);
+    float * row(GridPlane plane, size_t i) { return &data[plane * plane_stride + i * stride + 1]; }
+    const float * row(GridPlane plane, size_t i) const { return &data[plane * plane_stride + i * stride + 1]; }
+    glm::vec3 get(GridPlane x, size_t i, size_t j) const;
+    void wrapRows(GridPlane first, GridPlane last);
+};
+
+void SurfaceGrid::resize(size_t rows, size_t cols) {
+  this->rows = rows;
+  this->cols = cols;
+  stride = cols + 2;
+  plane_stride = rows * stride;
+  data.assign(plane_stride * GRID_PLANE_COUNT, 0.0f);
+}
+
+glm::vec3 SurfaceGrid::get(GridPlane x, size_t i, size_t j) const {
+  return glm::vec3(row(x, i)[j], row((GridPlane)(x + 1), i)[j], row((GridPlane)(x + 2), i)[j]);
+}
+
+void SurfaceGrid::wrapRows(GridPlane first, GridPlane last) {
+  // Refresh ghost columns : [-1] mirrors the last point, [cols] mirrors the first one
+  for (int plane = first; plane <= last; ++plane) {
+    for (size_t i = 0; i < rows; ++i) {
+      float * r = row((GridPlane)plane, i);
+      r[-1] = r[cols - 1];
+      r[cols] = r[0];
+    }
+  }
+}
+
 class Section {
+    // Non-owning view of one section (grid row)
 public:
-    std::vector<glm::vec3> points;
-    std::vector<glm::vec3> tangents;
-    Section(RawSection &, CurveType);
+    const float * x, * y, * z;
+    const float * tx, * ty, * tz;
+    size_t count;
+    Section(const SurfaceGrid &, size_t);
+    glm::vec3 point(ptrdiff_t j) const { return glm::vec3(x[j], y[j], z[j]); }
+    glm::vec3 tangent(ptrdiff_t j) const { return glm::vec3(tx[j], ty[j], tz[j]); }
+    size_t size() const { return count; }
 };
 
-Section::Section(RawSection & rawSection, CurveType curveType) {
-  // Generate n points from Control points
-  points.clear();
-  tangents.clear();
+Section::Section(const SurfaceGrid & grid, size_t i)
+    : x(grid.row(GRID_PX, i)), y(grid.row(GRID_PY, i)), z(grid.row(GRID_PZ, i)),
+      tx(grid.row(GRID_TX, i)), ty(grid.row(GRID_TY, i)), tz(grid.row(GRID_TZ, i)),
+      count(grid.cols) { }
+
+void tessellateSection(RawSection & rawSection, CurveType curveType, std::vector<glm::vec3> & control_points,
+                       SurfaceGrid & grid, size_t row) {
+  // Generate n points from Control points, written into given grid row
+  float * px = grid.row(GRID_PX, row), * py = grid.row(GRID_PY, row), * pz = grid.row(GRID_PZ, row);
+  float * tx = grid.row(GRID_TX, row), * ty = grid.row(GRID_TY, row), * tz = grid.row(GRID_TZ, row);
 
   // Move raw control points to world space
-  std::vector<glm::vec3> control_points;
+  glm::mat4 rotate = glm::toMat4(rawSection.rotate);
+  control_points.clear();
   for (int i = 0; i < rawSection.control_points.size(); ++i) {
     glm::vec3 point = glm::vec3(rawSection.control_points[i].x, 0.0f, rawSection.control_points[i].y);
     point = point * (float)rawSection.scale;
-    point = glm::vec3(glm::toMat4(rawSection.rotate) * glm::vec4(point, 1.0f));
+    point = glm::vec3(rotate * glm::vec4(point, 1.0f));
     point += rawSection.position;
     control_points.push_back(point);
   }
 
   // Generate closed curve
   size_t cnt = control_points.size();
-  if (curveType == CurveType::BSpline) {
-    for (int i = 0; i < cnt; ++i) {
-      glm::vec3 p0 = control_points[i];
-      glm::vec3 p1 = control_points[(i + 1) % cnt];
-      glm::vec3 p2 = control_points[(i + 2) % cnt];
-      glm::vec3 p3 = control_points[(i + 3) % cnt];
-      // B-Spline
-      for (int k = 0; k < N_SPLINE; ++k) {
-        float t = (float) k / N_SPLINE;
-        glm::vec3 point = bspline(p0, p1, p2, p3, t);
-        glm::vec3 tangent = bspline_tanget(p0, p1, p2, p3, t);
-        points.push_back(point);
-        tangents.push_back(tangent);
+  size_t idx = 0;
+  for (int i = 0; i < cnt; ++i) {
+    glm::vec3 p0 = control_points[i];
+    glm::vec3 p1 = control_points[(i + 1) % cnt];
+    glm::vec3 p2 = control_points[(i + 2) % cnt];
+    glm::vec3 p3 = control_points[(i + 3) % cnt];
+    for (int k = 0; k < N_SPLINE; ++k, ++idx) {
+      float t = (float) k / N_SPLINE;
+      glm::vec3 point, tangent;
+      if (curveType == CurveType::BSpline) {
+        point = bspline(p0, p1, p2, p3, t);
+        tangent = bspline_tanget(p0, p1, p2, p3, t);
       }
-    }
-  }
-  else {
-    for (int i = 0; i < cnt; ++i) {
-      glm::vec3 p0 = control_points[i];
-      glm::vec3 p1 = control_points[(i + 1) % cnt];
-      glm::vec3 p2 = control_points[(i + 2) % cnt];
-      glm::vec3 p3 = control_points[(i + 3) % cnt];
-      // B-Spline
-      for (int k = 0; k < N_SPLINE; ++k) {
-        float t = (float) k / N_SPLINE;
+      else {
         glm::vec3 t1 = (p2 - p0) / 2.0f;
         glm::vec3 t2 = (p3 - p1) / 2.0f;
-        glm::vec3 point = catmullrom(p1, p2, t1, t2, t);
-        glm::vec3 tangent = catmullrom_tangent(p1, p2, t1, t2, t);
-        points.push_back(point);
-        tangents.push_back(tangent);
+        point = catmullrom(p1, p2, t1, t2, t);
+        tangent = catmullrom_tangent(p1, p2, t1, t2, t);
       }
+      px[idx] = point.x; py[idx] = point.y; pz[idx] = point.z;
+      tx[idx] = tangent.x; ty[idx] = tangent.y; tz[idx] = tangent.z;
     }
   }
 }
@@ -89,14 +144,48 @@ public:
     std::vector<RawSection> sections;
     CurveType surfaceType;
     static RawSurface createFromFile(const char *);
+    bool saveBinary(const char *) const;
+private:
+    bool parseText(const char *, const MappedFile &);
+    bool parseBinary(const char *, const MappedFile &);
 };
 
+// Binary companion format of the sweep description (native byte order, no per-number parsing ;
+// byte_order tells files from a machine of the other endianness, which are rejected) :
+//   RawSurfaceFileHeader
+//   RawSectionRecord x section_count
+//   float[2]         x section_count * control_point_count (x, z control points, section after section)
+static const char RAW_SURFACE_MAGIC[4] = { 'R', 'S', 'R', 'F' };
+static const uint32_t RAW_SURFACE_VERSION = 2;
+static const uint32_t RAW_SURFACE_BYTE_ORDER = 0x01020304;
+
+struct RawSurfaceFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t curve_type;
+    uint32_t section_count;
+    uint32_t control_point_count;
+    uint32_t byte_order;  // RAW_SURFACE_BYTE_ORDER as written by the saving machine
+    uint32_t reserved[2];
+};
+
+struct RawSectionRecord {
+    double scale;
+    float rotate[4];    // w, x, y, z
+    float position[3];
+    float padding;
+};
+
+static_assert(sizeof(RawSurfaceFileHeader) == 32, "RawSurfaceFileHeader must be tightly packed");
+static_assert(sizeof(RawSectionRecord) == 40, "RawSectionRecord must be tightly packed");
+
 class Surface {
 public:
-    std::vector<Section> sections;
-    std::vector<glm::vec3> normals;
+    SurfaceGrid grid;
     CurveType curveType;
     Surface(RawSurface &);
+    Section section(size_t i) const { return Section(grid, i); }
+    glm::vec3 normal(size_t i, size_t j) const { return grid.get(GRID_NX, i, j); }
     void fillVertices(GLfloat *);
     void fillNormalVertices(GLfloat *);
     void fillMeshVertices(GLfloat *);
@@ -112,10 +201,20 @@ Surface::Surface(RawSurface & rawSurface) {
   curveType = rawSurface.surfaceType;
 
   const size_t rawSectionCnt = rawSurface.sections.size();
+  if (rawSectionCnt < 2) return;
+  const size_t rawPointCnt = rawSurface.sections[0].control_points.size();
+  grid.resize((rawSectionCnt - 1) * N_SPLINE, rawPointCnt * N_SPLINE);
+
+  // Scratch buffers shared by every interpolating section
+  RawSection rawSection;
+  rawSection.control_points.resize(rawPointCnt);
+  std::vector<glm::vec3> world_points;
+  world_points.reserve(rawPointCnt);
+
   for (int i = 0; i < rawSectionCnt - 1; ++i) {
     // For each consecutive Raw Sections, create subsurface by generating interpolating sections
-    RawSection s1 = rawSurface.sections[i];
-    RawSection s2 = rawSurface.sections[i + 1];
+    const RawSection & s1 = rawSurface.sections[i];
+    const RawSection & s2 = rawSurface.sections[i + 1];
 
     for (int j = 0; j < N_SPLINE; ++j) {
       float t = (float)j / N_SPLINE;
@@ -137,177 +236,309 @@ Surface::Surface(RawSurface & rawSurface) {
       glm::vec3 position = catmullrom(s1.position, s2.position, pt1, pt2, t);
 
       // Generate interpolating section
-      std::vector<glm::vec2> control_points;
-      for (int k = 0; k < s1.control_points.size(); ++k) {
+      for (int k = 0; k < rawPointCnt; ++k) {
         glm::vec2 cpt1 = (i == 0) ? (s2.control_points[k] - s1.control_points[k]) / 2.0f : (s2.control_points[k] - rawSurface.sections[i - 1].control_points[k]) / 2.0f;
         glm::vec2 cpt2 = (i == rawSectionCnt - 2) ? (s2.control_points[k] - s1.control_points[k]) / 2.0f : (rawSurface.sections[i + 2].control_points[k] - s1.control_points[k]) / 2.0f;
-        control_points.push_back(catmullrom(s1.control_points[k], s2.control_points[k], cpt1, cpt2, t));
+        rawSection.control_points[k] = catmullrom(s1.control_points[k], s2.control_points[k], cpt1, cpt2, t);
       }
-      RawSection rawSection;
-      rawSection.control_points = control_points;
       rawSection.scale = scale;
       rawSection.rotate = rotate;
       rawSection.position = position;
-      Section section = Section(rawSection, curveType);
-
-      sections.push_back(section);
+      tessellateSection(rawSection, curveType, world_points, grid, i * N_SPLINE + j);
     }
   }
-  for (int i = 0; i < rawSectionCnt; ++i) {
-    const size_t pcnt = sections[i].points.size();
-    for (int j = 0; j < pcnt; ++j) {
-      glm::vec3 pl = sections[i].points[(j - 1 + pcnt) % pcnt];
-      glm::vec3 pr = sections[i].points[(j + 1 + pcnt) % pcnt];
-      glm::vec3 pu = sections[(i - 1 + rawSectionCnt) % rawSectionCnt].points[j];
-      glm::vec3 pd = sections[(i + 1 + rawSectionCnt) % rawSectionCnt].points[j];
-      glm::vec3 normal = glm::cross(pr - pl, pu - pd);
-      normals.push_back(normal);
+  grid.wrapRows(GRID_PX, GRID_TZ);
+
+  // Vertex normals from central differences, one-sided at the first / last section
+  const size_t rows = grid.rows, cols = grid.cols;
+  for (size_t i = 0; i < rows; ++i) {
+    const size_t up = (i == 0) ? i : i - 1;
+    const size_t down = (i == rows - 1) ? i : i + 1;
+    const float * x = grid.row(GRID_PX, i), * y = grid.row(GRID_PY, i), * z = grid.row(GRID_PZ, i);
+    const float * ux = grid.row(GRID_PX, up), * uy = grid.row(GRID_PY, up), * uz = grid.row(GRID_PZ, up);
+    const float * dx = grid.row(GRID_PX, down), * dy = grid.row(GRID_PY, down), * dz = grid.row(GRID_PZ, down);
+    float * nx = grid.row(GRID_NX, i), * ny = grid.row(GRID_NY, i), * nz = grid.row(GRID_NZ, i);
+    for (size_t j = 0; j < cols; ++j) {
+      // normal = cross(pr - pl, pu - pd)
+      float ax = x[j + 1] - x[j - 1], ay = y[j + 1] - y[j - 1], az = z[j + 1] - z[j - 1];
+      float bx = ux[j] - dx[j], by = uy[j] - dy[j], bz = uz[j] - dz[j];
+      nx[j] = ay * bz - az * by;
+      ny[j] = az * bx - ax * bz;
+      nz[j] = ax * by - ay * bx;
     }
   }
+  grid.wrapRows(GRID_NX, GRID_NZ);
+}
+
+static void printSurfaceError(const char * path, const TextScanner & scanner, const char * message) {
+  printf("%s:%zu:%zu: %s\n", path, scanner.line(), scanner.column(), message);
 }
 
 RawSurface RawSurface::createFromFile(const char * path) {
-  FILE * file = fopen(path, "r");
+  // Accepts both the text description and its binary companion (see saveBinary)
   RawSurface rawSurface;
-  if (file == NULL) {
-    printf("Failed to open spline data file\n");
+  MappedFile file;
+  if (!file.open(path)) {
+    printf("Failed to open spline data file %s\n", path);
     return rawSurface;
   }
 
-  char curve_type_string[32];
-  CurveType curve_type;
-  fscanf(file, "%s", curve_type_string);
-  if (strcmp(curve_type_string, "BSPLINE") == 0) curve_type = CurveType::BSpline;
-  else if (strcmp(curve_type_string, "CATMULL_ROM") == 0) curve_type = CurveType::CatmullRom;
+  bool ok;
+  if (file.size() >= sizeof(RAW_SURFACE_MAGIC) && memcmp(file.data(), RAW_SURFACE_MAGIC, sizeof(RAW_SURFACE_MAGIC)) == 0)
+    ok = rawSurface.parseBinary(path, file);
+  else
+    ok = rawSurface.parseText(path, file);
+
+  if (!ok) rawSurface.sections.clear();
+  return rawSurface;
+}
+
+bool RawSurface::parseText(const char * path, const MappedFile & file) {
+  TextScanner scanner(file.begin(), file.end());
+
+  const char * word;
+  size_t length;
+  if (!scanner.readWord(word, length)) {
+    printSurfaceError(path, scanner, "expected curve type, found end of file");
+    return false;
+  }
+  if (length == 7 && memcmp(word, "BSPLINE", 7) == 0) surfaceType = CurveType::BSpline;
+  else if (length == 11 && memcmp(word, "CATMULL_ROM", 11) == 0) surfaceType = CurveType::CatmullRom;
   else {
-    printf("Invalid curve type\n");
-    return rawSurface;
+    printf("%s:%zu:%zu: invalid curve type '%.*s'\n", path, scanner.line(), scanner.column() - length, (int)length, word);
+    return false;
+  }
+
+  long long num_cross_section, num_control_point;
+  if (!scanner.readInt(num_cross_section) || !scanner.readInt(num_control_point)) {
+    printSurfaceError(path, scanner, "expected cross section count and control point count");
+    return false;
+  }
+  if (num_cross_section < 2 || num_control_point < 1) {
+    printSurfaceError(path, scanner, "need at least 2 cross sections and 1 control point");
+    return false;
+  }
+  // Every number takes at least one character, this also bounds the allocations below
+  // Compared by division : both counts are unbounded here and their product could overflow
+  if (num_control_point > (long long)file.size() || num_cross_section > (long long)file.size() / (2 * num_control_point + 8)) {
+    printSurfaceError(path, scanner, "cross section / control point count exceeds file size");
+    return false;
   }
-  rawSurface.surfaceType = curve_type;
 
-  int num_cross_section, num_control_point;
-  fscanf(file, "%d %d", &num_cross_section, &num_control_point);
-  for (int i = 0; i < num_cross_section; ++i) {
-    RawSection cs;
-    for (int j = 0; j < num_control_point; ++j) {
+  sections.resize((size_t)num_cross_section);
+  for (size_t i = 0; i < sections.size(); ++i) {
+    RawSection & cs = sections[i];
+    cs.control_points.resize((size_t)num_control_point);
+    for (size_t j = 0; j < cs.control_points.size(); ++j) {
       double x, z;
-      fscanf(file, "%lf %lf", &x, &z);
-      cs.control_points.push_back(glm::vec2(x, z));
+      if (!scanner.readDouble(x) || !scanner.readDouble(z)) {
+        printSurfaceError(path, scanner, "expected control point 'x z'");
+        return false;
+      }
+      cs.control_points[j] = glm::vec2(x, z);
     }
     double scale;
     double angle;
     double x, y, z;
-    fscanf(file, "%lf", &scale);
-    fscanf(file, "%lf %lf %lf %lf", &angle, &x, &y, &z);
+    if (!scanner.readDouble(scale)) {
+      printSurfaceError(path, scanner, "expected section scale");
+      return false;
+    }
+    if (!scanner.readDouble(angle) || !scanner.readDouble(x) || !scanner.readDouble(y) || !scanner.readDouble(z)) {
+      printSurfaceError(path, scanner, "expected section rotation 'angle x y z'");
+      return false;
+    }
     cs.rotate = glm::quat(glm::cos(angle / 2.0), x * glm::sin(angle / 2.0), y * glm::sin(angle / 2.0), z * glm::sin(angle / 2.0));
-    fscanf(file, "%lf %lf %lf", &x, &y, &z);
-    glm::vec3 position = glm::vec3(x, y, z);
-
+    if (!scanner.readDouble(x) || !scanner.readDouble(y) || !scanner.readDouble(z)) {
+      printSurfaceError(path, scanner, "expected section position 'x y z'");
+      return false;
+    }
     cs.scale = scale;
-    cs.position = position;
-    rawSurface.sections.push_back(cs);
+    cs.position = glm::vec3(x, y, z);
   }
-  return rawSurface;
+  if (scanner.skipBlank()) {
+    printSurfaceError(path, scanner, "warning: ignoring trailing data");
+  }
+  return true;
+}
+
+bool RawSurface::parseBinary(const char * path, const MappedFile & file) {
+  RawSurfaceFileHeader header;
+  if (file.size() < sizeof(header)) {
+    printf("%s: truncated binary surface header\n", path);
+    return false;
+  }
+  memcpy(&header, file.data(), sizeof(header));
+  if (header.byte_order != RAW_SURFACE_BYTE_ORDER) {
+    printf("%s: binary surface is from an older version or another byte order\n", path);
+    return false;
+  }
+  if (header.version != RAW_SURFACE_VERSION) {
+    printf("%s: unsupported binary surface version %u\n", path, header.version);
+    return false;
+  }
+  if (header.curve_type > (uint32_t)CurveType::CatmullRom || header.section_count < 2 || header.control_point_count < 1) {
+    printf("%s: invalid binary surface header\n", path);
+    return false;
+  }
+  const size_t section_count = header.section_count;
+  const size_t point_count = header.control_point_count;
+  // Bound each count by the file before multiplying, so that the size check below cannot wrap
+  if (section_count > (file.size() - sizeof(header)) / sizeof(RawSectionRecord)) {
+    printf("%s: binary surface section count exceeds file size\n", path);
+    return false;
+  }
+  const size_t points_offset = sizeof(header) + section_count * sizeof(RawSectionRecord);
+  if (point_count > (file.size() - points_offset) / sizeof(glm::vec2) / section_count) {
+    printf("%s: binary surface control point count exceeds file size\n", path);
+    return false;
+  }
+  if (file.size() != points_offset + section_count * point_count * sizeof(glm::vec2)) {
+    printf("%s: binary surface size does not match its header\n", path);
+    return false;
+  }
+
+  surfaceType = (CurveType)header.curve_type;
+  sections.resize(section_count);
+  const char * records = file.data() + sizeof(header);
+  const char * points = file.data() + points_offset;
+  for (size_t i = 0; i < section_count; ++i) {
+    RawSectionRecord record;
+    memcpy(&record, records + i * sizeof(record), sizeof(record));
+    RawSection & cs = sections[i];
+    cs.scale = record.scale;
+    cs.rotate = glm::quat(record.rotate[0], record.rotate[1], record.rotate[2], record.rotate[3]);
+    cs.position = glm::vec3(record.position[0], record.position[1], record.position[2]);
+    cs.control_points.resize(point_count);
+    memcpy(&cs.control_points[0], points + i * point_count * sizeof(glm::vec2), point_count * sizeof(glm::vec2));
+  }
+  return true;
+}
+
+bool RawSurface::saveBinary(const char * path) const {
+  // Write this surface in the binary companion format, loadable with createFromFile
+  if (sections.size() < 2 || sections[0].control_points.empty()) {
+    printf("Refusing to save an empty surface to %s\n", path);
+    return false;
+  }
+  const size_t point_count = sections[0].control_points.size();
+  for (size_t i = 0; i < sections.size(); ++i) {
+    if (sections[i].control_points.size() != point_count) {
+      printf("Cannot save %s : sections have different control point counts\n", path);
+      return false;
+    }
+  }
+
+  FILE * file = fopen(path, "wb");
+  if (file == NULL) {
+    printf("Failed to create binary surface file %s\n", path);
+    return false;
+  }
+  RawSurfaceFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, RAW_SURFACE_MAGIC, sizeof(header.magic));
+  header.version = RAW_SURFACE_VERSION;
+  header.curve_type = (uint32_t)surfaceType;
+  header.section_count = (uint32_t)sections.size();
+  header.control_point_count = (uint32_t)point_count;
+  header.byte_order = RAW_SURFACE_BYTE_ORDER;
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  for (size_t i = 0; ok && i < sections.size(); ++i) {
+    const RawSection & cs = sections[i];
+    RawSectionRecord record;
+    memset(&record, 0, sizeof(record));
+    record.scale = cs.scale;
+    record.rotate[0] = cs.rotate.w;
+    record.rotate[1] = cs.rotate.x;
+    record.rotate[2] = cs.rotate.y;
+    record.rotate[3] = cs.rotate.z;
+    record.position[0] = cs.position.x;
+    record.position[1] = cs.position.y;
+    record.position[2] = cs.position.z;
+    ok = fwrite(&record, sizeof(record), 1, file) == 1;
+  }
+  for (size_t i = 0; ok && i < sections.size(); ++i) {
+    ok = fwrite(&sections[i].control_points[0], sizeof(glm::vec2), point_count, file) == point_count;
+  }
+  if (fclose(file) != 0) ok = false;
+  if (!ok) printf("Failed to write binary surface file %s\n", path);
+  return ok;
 }
 
 void Surface::fillVertices(GLfloat * vertices) {
   // Fill given vertices memory for OpenGL
-  for (int i = 0; i < sections.size(); ++i) {
-    for (int j = 0; j < sections[i].points.size(); ++j) {
-      *(vertices + (i * sections[i].points.size() + j) * 3 + 0) = sections[i].points[j].x;
-      *(vertices + (i * sections[i].points.size() + j) * 3 + 1) = sections[i].points[j].y;
-      *(vertices + (i * sections[i].points.size() + j) * 3 + 2) = sections[i].points[j].z;
+  size_t idx = 0;
+  for (size_t i = 0; i < grid.rows; ++i) {
+    const float * x = grid.row(GRID_PX, i), * y = grid.row(GRID_PY, i), * z = grid.row(GRID_PZ, i);
+    for (size_t j = 0; j < grid.cols; ++j) {
+      vertices[idx++] = x[j];
+      vertices[idx++] = y[j];
+      vertices[idx++] = z[j];
     }
   }
 }
 
+static inline void putVertex(GLfloat * vertices, size_t & idx, glm::vec3 v) {
+  vertices[idx++] = v.x;
+  vertices[idx++] = v.y;
+  vertices[idx++] = v.z;
+}
+
 void Surface::fillNormalVertices(GLfloat * vertices) {
   // Fill given normals memory for OpenGL
-  size_t scnt = sections.size();
-  int idx = 0;
-  for (int i = 0; i < scnt; ++i) {
-    size_t cnt = sections[i].points.size();
-    for (int j = 0; j < cnt; ++j) {
+  // Every cell (i, j) emits an upper triangle (p[i][j], p[i-1][j], p[i-1][j+1]) unless i is the first section,
+  // and a lower triangle (p[i][j], p[i+1][j], p[i+1][j-1]) unless i is the last one.
+  const size_t scnt = grid.rows;
+  const ptrdiff_t cnt = grid.cols;
+  size_t idx = 0;
+  for (size_t i = 0; i < scnt; ++i) {
+    const bool upper = i > 0, lower = i < scnt - 1;
+    const Section cur = section(i);
+    const Section prev = section(upper ? i - 1 : i);
+    const Section next = section(lower ? i + 1 : i);
+    for (ptrdiff_t j = 0; j < cnt; ++j) {
+      glm::vec3 p11 = cur.point(j);
       // Upper Triangle
-      if (i > 0) {
-        glm::vec3 p11 = sections[i].points[j];
-        glm::vec3 p01 = sections[(i - 1 + scnt) % scnt].points[j];
-        glm::vec3 p02 = sections[(i - 1 + scnt) % scnt].points[(j + 1) % cnt];
-
-        glm::vec3 n1 = glm::normalize(glm::cross(p02 - p11, p01 - p11));
-
-        *(vertices + (idx++)) = n1.x;
-        *(vertices + (idx++)) = n1.y;
-        *(vertices + (idx++)) = n1.z;
-
-        *(vertices + (idx++)) = n1.x;
-        *(vertices + (idx++)) = n1.y;
-        *(vertices + (idx++)) = n1.z;
-
-        *(vertices + (idx++)) = n1.x;
-        *(vertices + (idx++)) = n1.y;
-        *(vertices + (idx++)) = n1.z;
+      if (upper) {
+        glm::vec3 n1 = glm::normalize(glm::cross(prev.point(j + 1) - p11, prev.point(j) - p11));
+        putVertex(vertices, idx, n1);
+        putVertex(vertices, idx, n1);
+        putVertex(vertices, idx, n1);
       }
-
       // Lower Triangle
-      if (i < scnt - 1) {
-        glm::vec3 p11 = sections[i].points[j];
-        glm::vec3 p21 = sections[(i + 1 + scnt) % scnt].points[j];
-        glm::vec3 p20 = sections[(i + 1 + scnt) % scnt].points[(j - 1 + cnt) % cnt];
-
-        glm::vec3 n2 = glm::normalize(glm::cross(p20 - p11, p21 - p11));
-
-        *(vertices + (idx++)) = n2.x;
-        *(vertices + (idx++)) = n2.y;
-        *(vertices + (idx++)) = n2.z;
-
-        *(vertices + (idx++)) = n2.x;
-        *(vertices + (idx++)) = n2.y;
-        *(vertices + (idx++)) = n2.z;
-
-        *(vertices + (idx++)) = n2.x;
-        *(vertices + (idx++)) = n2.y;
-        *(vertices + (idx++)) = n2.z;
+      if (lower) {
+        glm::vec3 n2 = glm::normalize(glm::cross(next.point(j - 1) - p11, next.point(j) - p11));
+        putVertex(vertices, idx, n2);
+        putVertex(vertices, idx, n2);
+        putVertex(vertices, idx, n2);
       }
     }
   }
 }
 
 void Surface::fillMeshVertices(GLfloat * vertices) {
-  // Fill given vertices memory for OpenGL
-  size_t scnt = sections.size();
-  int idx = 0;
-  for (int i = 0; i < scnt; ++i) {
-    size_t cnt = sections[i].points.size();
-    for (int j = 0; j < cnt; ++j) {
+  // Fill given vertices memory for OpenGL, same triangle order as fillNormalVertices
+  const size_t scnt = grid.rows;
+  const ptrdiff_t cnt = grid.cols;
+  size_t idx = 0;
+  for (size_t i = 0; i < scnt; ++i) {
+    const bool upper = i > 0, lower = i < scnt - 1;
+    const Section cur = section(i);
+    const Section prev = section(upper ? i - 1 : i);
+    const Section next = section(lower ? i + 1 : i);
+    for (ptrdiff_t j = 0; j < cnt; ++j) {
       // Upper Triangle
-      if (i > 0) {
-        *(vertices + (idx++)) = sections[i].points[j].x;
-        *(vertices + (idx++)) = sections[i].points[j].y;
-        *(vertices + (idx++)) = sections[i].points[j].z;
-
-        *(vertices + (idx++)) = sections[(i - 1 + scnt) % scnt].points[j].x;
-        *(vertices + (idx++)) = sections[(i - 1 + scnt) % scnt].points[j].y;
-        *(vertices + (idx++)) = sections[(i - 1 + scnt) % scnt].points[j].z;
-
-        *(vertices + (idx++)) = sections[(i - 1 + scnt) % scnt].points[(j + 1) % cnt].x;
-        *(vertices + (idx++)) = sections[(i - 1 + scnt) % scnt].points[(j + 1) % cnt].y;
-        *(vertices + (idx++)) = sections[(i - 1 + scnt) % scnt].points[(j + 1) % cnt].z;
+      if (upper) {
+        putVertex(vertices, idx, cur.point(j));
+        putVertex(vertices, idx, prev.point(j));
+        putVertex(vertices, idx, prev.point(j + 1));
       }
-
       // Lower Triangle
-      if (i < scnt - 1) {
-        *(vertices + (idx++)) = sections[i].points[j].x;
-        *(vertices + (idx++)) = sections[i].points[j].y;
-        *(vertices + (idx++)) = sections[i].points[j].z;
-
-        *(vertices + (idx++)) = sections[(i + 1) % scnt].points[j].x;
-        *(vertices + (idx++)) = sections[(i + 1) % scnt].points[j].y;
-        *(vertices + (idx++)) = sections[(i + 1) % scnt].points[j].z;
-
-        *(vertices + (idx++)) = sections[(i + 1) % scnt].points[(j - 1 + cnt) % cnt].x;
-        *(vertices + (idx++)) = sections[(i + 1) % scnt].points[(j - 1 + cnt) % cnt].y;
-        *(vertices + (idx++)) = sections[(i + 1) % scnt].points[(j - 1 + cnt) % cnt].z;
+      if (lower) {
+        putVertex(vertices, idx, cur.point(j));
+        putVertex(vertices, idx, next.point(j));
+        putVertex(vertices, idx, next.point(j - 1));
       }
     }
   }
@@ -315,20 +546,21 @@ void Surface::fillMeshVertices(GLfloat * vertices) {
 
 size_t Surface::dataSize() {
   // Total number of points * 3(xyz)
-  return sections.size() * sections[0].points.size() * 3;
+  return grid.rows * grid.cols * 3;
 }
 
 size_t Surface::meshDataSize() {
-  // Total number of points * 3(xyz) * 2
-  return (sections.size() - 1) * sections[0].points.size() * 3 * 6;
+  // Total number of points * 3(xyz) * 2 ; no quads without two sections
+  if (grid.rows < 2) return 0;
+  return (grid.rows - 1) * grid.cols * 3 * 6;
 }
 
 size_t Surface::section_count() {
-  return sections.size();
+  return grid.rows;
 }
 
 size_t Surface::per_section_point_count() {
-  return sections[0].points.size();
+  return grid.cols;
 }
 
 #endif //GRAPHICS_SURFACE_H